@@ -0,0 +1,204 @@
+// Compare system calls made one at a time with the same calls
+// queued on a ring and run by one sysbatch(): stat() of every
+// entry in a large directory, as ls does, and a loop copying
+// small files.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "fs.h"
+#include "x86.h"
+#include "syscall.h"
+#include "sysring.h"
+
+#define NFILE  60
+#define FSIZE  100
+#define GROUP  6    // files open at once, two fds each for copying
+
+char names[NFILE][32];
+int nnames;
+char data[GROUP][FSIZE];
+struct sysring ring;
+
+void
+fail(char *what)
+{
+  printf(1, "batchbench: %s\n", what);
+  exit();
+}
+
+void
+setup(void)
+{
+  char buf[FSIZE];
+  int i, fd;
+
+  memset(buf, 'x', sizeof(buf));
+  if(mkdir("bdir") < 0)
+    fail("mkdir bdir");
+  for(i = 0; i < NFILE; i++){
+    strcpy(names[i], "bdir/f000");
+    names[i][6] = '0' + i/100;
+    names[i][7] = '0' + i/10%10;
+    names[i][8] = '0' + i%10;
+    if((fd = open(names[i], O_CREATE|O_WRONLY)) < 0 ||
+       write(fd, buf, sizeof(buf)) != sizeof(buf))
+      fail("create");
+    close(fd);
+  }
+}
+
+// Read the directory's entries into names, as ls does.
+void
+readdir(void)
+{
+  struct dirent de;
+  int fd;
+
+  if((fd = open("bdir", 0)) < 0)
+    fail("open bdir");
+  nnames = 0;
+  while(read(fd, &de, sizeof(de)) == sizeof(de) && nnames < NFILE){
+    if(de.inum == 0 || de.name[0] == '.')
+      continue;
+    strcpy(names[nnames], "bdir/");
+    memmove(names[nnames]+5, de.name, DIRSIZ);
+    names[nnames][5+DIRSIZ] = 0;
+    nnames++;
+  }
+  close(fd);
+}
+
+void
+liststat(void)
+{
+  struct stat st;
+  int i;
+
+  for(i = 0; i < nnames; i++)
+    if(stat(names[i], &st) < 0 || st.size != FSIZE)
+      fail("stat");
+}
+
+// Two batches per group: the opens, then an fstat() and a
+// close() per file descriptor they returned.
+void
+liststatbatch(void)
+{
+  struct sysent *op[2*GROUP];
+  struct stat st[2*GROUP];
+  int i, j, n;
+
+  for(i = 0; i < nnames; i += n){
+    n = nnames - i < 2*GROUP ? nnames - i : 2*GROUP;
+    for(j = 0; j < n; j++)
+      op[j] = sysqueue(&ring, SYS_open, (int)names[i+j], O_RDONLY, 0);
+    sysbatch(&ring);
+    for(j = 0; j < n; j++){
+      if(op[j]->ret < 0)
+        fail("batched open");
+      sysqueue(&ring, SYS_fstat, op[j]->ret, (int)&st[j], 0);
+      sysqueue(&ring, SYS_close, op[j]->ret, 0, 0);
+    }
+    sysbatch(&ring);
+    for(j = 0; j < n; j++)
+      if(st[j].size != FSIZE)
+        fail("batched fstat");
+  }
+}
+
+void
+dstname(char *dst, char *src)
+{
+  strcpy(dst, src);
+  dst[5] = 'c';
+}
+
+void
+copy(void)
+{
+  char dst[32];
+  int i, fd;
+
+  for(i = 0; i < nnames; i++){
+    if((fd = open(names[i], O_RDONLY)) < 0 ||
+       read(fd, data[0], FSIZE) != FSIZE)
+      fail("copy read");
+    close(fd);
+    dstname(dst, names[i]);
+    if((fd = open(dst, O_CREATE|O_WRONLY)) < 0 ||
+       write(fd, data[0], FSIZE) != FSIZE)
+      fail("copy write");
+    close(fd);
+  }
+}
+
+// Two batches per group: the opens, then the reads, writes
+// and closes, which run in order.
+void
+copybatch(void)
+{
+  char dst[GROUP][32];
+  struct sysent *in[GROUP], *out[GROUP];
+  int i, j, n;
+
+  for(i = 0; i < nnames; i += n){
+    n = nnames - i < GROUP ? nnames - i : GROUP;
+    for(j = 0; j < n; j++){
+      dstname(dst[j], names[i+j]);
+      in[j] = sysqueue(&ring, SYS_open, (int)names[i+j], O_RDONLY, 0);
+      out[j] = sysqueue(&ring, SYS_open, (int)dst[j], O_CREATE|O_WRONLY, 0);
+    }
+    sysbatch(&ring);
+    for(j = 0; j < n; j++){
+      if(in[j]->ret < 0 || out[j]->ret < 0)
+        fail("batched copy open");
+      sysqueue(&ring, SYS_read, in[j]->ret, (int)data[j], FSIZE);
+      sysqueue(&ring, SYS_write, out[j]->ret, (int)data[j], FSIZE);
+      sysqueue(&ring, SYS_close, in[j]->ret, 0, 0);
+      sysqueue(&ring, SYS_close, out[j]->ret, 0, 0);
+    }
+    sysbatch(&ring);
+  }
+}
+
+void
+cleanup(void)
+{
+  char dst[32];
+  int i;
+
+  for(i = 0; i < nnames; i++){
+    dstname(dst, names[i]);
+    unlink(dst);
+    unlink(names[i]);
+  }
+  unlink("bdir");
+}
+
+void
+bench(char *what, void (*f)(void))
+{
+  uint t0, t1;
+
+  t0 = rdtsc();
+  f();
+  t1 = rdtsc();
+  printf(1, "%s: %d cycles per file\n", what, (t1 - t0) / nnames);
+}
+
+int
+main(int argc, char *argv[])
+{
+  setup();
+  readdir();
+  if(nnames != NFILE)
+    fail("readdir");
+  bench("stat", liststat);
+  bench("batched stat", liststatbatch);
+  bench("copy", copy);
+  bench("batched copy", copybatch);
+  cleanup();
+  exit();
+}
@@ -0,0 +1,65 @@
+// Check that a file read twice comes from the buffer cache
+// the second time, and print the cache's statistics.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "kstat.h"
+
+#define NBLOCK 64
+
+char buf[512];
+
+void
+fail(char *what)
+{
+  printf(1, "bcacheTest: %s\n", what);
+  unlink("bcachefile");
+  exit();
+}
+
+void
+readall(void)
+{
+  int fd, i;
+
+  if((fd = open("bcachefile", O_RDONLY)) < 0)
+    fail("open");
+  for(i = 0; i < NBLOCK; i++)
+    if(read(fd, buf, sizeof(buf)) != sizeof(buf) || buf[0] != (char)i)
+      fail("read");
+  close(fd);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct kbufstat s0, s1;
+  int fd, i;
+
+  if((fd = open("bcachefile", O_CREATE|O_WRONLY)) < 0)
+    fail("create");
+  for(i = 0; i < NBLOCK; i++){
+    buf[0] = i;
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf))
+      fail("write");
+  }
+  close(fd);
+
+  readall();
+  kbufstat(&s0);
+  readall();
+  kbufstat(&s1);
+  if(s1.nread != s0.nread)
+    fail("second read went to disk");
+  if(s1.nhit - s0.nhit < NBLOCK)
+    fail("second read missed");
+
+  printf(1, "%d buffers: %d hits, %d misses, %d evictions, "
+         "%d reads, %d writes\n", s1.nbuf, s1.nhit, s1.nmiss,
+         s1.nevict, s1.nread, s1.nwrite);
+  unlink("bcachefile");
+  printf(1, "bcacheTest ok\n");
+  exit();
+}
@@ -1,9 +1,9 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
-// cached copies of disk block contents.  Caching disk blocks
-// in memory reduces the number of disk reads and also provides
-// a synchronization point for disk blocks used by multiple processes.
+// The buffer cache holds cached copies of disk block contents
+// in buf structures.  Caching disk blocks in memory reduces
+// the number of disk reads and also provides a synchronization
+// point for disk blocks used by multiple processes.
 //
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
@@ -17,79 +17,244 @@
 // * B_VALID: the buffer data has been read from the disk.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
+//
+// binit() sizes the cache from the memory found at boot.
+// Buffers are found through a hash table of (dev, blockno),
+// each bucket with its own lock, which also guards the
+// refcnt of the buffers in it, so a hit takes one bucket
+// lock.  Buffers nobody holds are also on an LRU free list
+// under bcache.lock.  A miss takes bcache.evictlock, so that
+// only one process at a time recycles a buffer, and reuses
+// the least recently released one.
+//
+// Lock order: evictlock, then a bucket lock, then bcache.lock.
+//
+// bwritestart() queues a write without waiting, so that a caller
+// can keep several on the disk queue at once and then wait for
+// them with bwaitany() or bwaitall().  breadahead() starts
+// reading a block the file system expects to need soon and
+// returns at once.  The buffer stays locked
+// until the disk interrupt hands it to bdone(), so a reader
+// that gets there first waits for the disk as usual.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
+#include "x86.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "kstat.h"
 
-struct {
+#define NBUCKET 509
+
+struct bucket {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct buf *head;   // chain through hnext
+  uint nhit;
+};
+
+struct {
+  struct spinlock lock;       // the free list
+  struct spinlock evictlock;  // one miss at a time
+  int nbuf;
 
-  // Linked list of all buffers, through prev/next.
-  // head.next is most recently used.
+  // Free list of unheld buffers, through prev/next.
+  // head.next is most recently released.
   struct buf head;
+
+  int nfree;                  // buffers on the free list
+
+  uint nmiss;
+  uint nevict;
+  uint nread;
+  uint nwrite;
+  uint nreadahead;
 } bcache;
 
+struct bucket buckets[NBUCKET];
+
+static struct bucket*
+bucket(uint dev, uint blockno)
+{
+  return &buckets[(dev * 31 + blockno) % NBUCKET];
+}
+
+// Put b at the most recently used end of the free list.
+// Caller holds b's bucket lock.
+static void
+freebuf(struct buf *b)
+{
+  acquire(&bcache.lock);
+  b->next = bcache.head.next;
+  b->prev = &bcache.head;
+  bcache.head.next->prev = b;
+  bcache.head.next = b;
+  bcache.nfree++;
+  release(&bcache.lock);
+}
+
+// Take b off the free list, if it is on it.
+// Caller holds b's bucket lock.
+static void
+unfreebuf(struct buf *b)
+{
+  acquire(&bcache.lock);
+  if(b->next){
+    b->next->prev = b->prev;
+    b->prev->next = b->next;
+    b->next = b->prev = 0;
+    bcache.nfree--;
+  }
+  release(&bcache.lock);
+}
+
+// Size the cache at BCACHEFRAC of directly mapped memory, and
+// carve the buffers out of whole pages.  Called after kinit2().
 void
 binit(void)
 {
+  struct bucket *bk;
   struct buf *b;
+  char *page;
+  int i, n;
 
   initlock(&bcache.lock, "bcache");
-
-//PAGEBREAK!
-  // Create linked list of buffers
+  initlock(&bcache.evictlock, "bcache.evict");
+  for(bk = buckets; bk < &buckets[NBUCKET]; bk++)
+    initlock(&bk->lock, "bcache.bucket");
   bcache.head.prev = &bcache.head;
   bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+
+  n = phystop / BCACHEFRAC / sizeof(struct buf);
+  if(n < NBUF)
+    n = NBUF;
+  if(n > NBUFMAX)
+    n = NBUFMAX;
+  while(bcache.nbuf < n){
+    if((page = kalloc()) == 0)
+      break;
+    for(i = 0; i + sizeof(*b) <= PGSIZE && bcache.nbuf < n; i += sizeof(*b)){
+      b = (struct buf*)(page + i);
+      memset(b, 0, sizeof(*b));
+      // Not hashed until first used; no block has this number.
+      b->blockno = ~0;
+      initsleeplock(&b->lock, "buffer");
+      freebuf(b);
+      bcache.nbuf++;
+    }
   }
+  if(bcache.nbuf < NBUF)
+    panic("binit");
 }
 
-// Look through buffer cache for block on device dev.
-// If not found, allocate a buffer.
-// In either case, return locked buffer.
+// Return the buffer for dev and blockno in bk, with a reference
+// taken, or 0.  Caller holds bk->lock.
 static struct buf*
-bget(uint dev, uint blockno)
+bfind(struct bucket *bk, uint dev, uint blockno)
 {
   struct buf *b;
 
-  acquire(&bcache.lock);
-
-  // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+  for(b = bk->head; b; b = b->hnext){
     if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
+      if(b->refcnt++ == 0)
+        unfreebuf(b);
+      bk->nhit++;
       return b;
     }
   }
+  return 0;
+}
+
+static void
+unhash(struct bucket *bk, struct buf *b)
+{
+  struct buf **pp;
+
+  for(pp = &bk->head; *pp; pp = &(*pp)->hnext){
+    if(*pp == b){
+      *pp = b->hnext;
+      return;
+    }
+  }
+}
+
+// Take the least recently released buffer that holds no
+// uncommitted data off the free list and out of its bucket.
+// Caller holds evictlock.
+static struct buf*
+evict(void)
+{
+  struct bucket *bk;
+  struct buf *b;
 
-  // Not cached; recycle an unused buffer.
-  // Even if refcnt==0, B_DIRTY indicates a buffer is in use
-  // because log.c has modified it but not yet committed it.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->flags = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
+  for(;;){
+    // Even if refcnt==0, B_DIRTY indicates a buffer is in use
+    // because log.c has modified it but not yet committed it.
+    acquire(&bcache.lock);
+    for(b = bcache.head.prev; b != &bcache.head; b = b->prev)
+      if((b->flags & B_DIRTY) == 0)
+        break;
+    if(b == &bcache.head)
+      panic("bget: no buffers");
+    release(&bcache.lock);
+
+    // A hit may take b before we have its bucket lock.
+    bk = bucket(b->dev, b->blockno);
+    acquire(&bk->lock);
+    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0){
+      unfreebuf(b);
+      unhash(bk, b);
+      release(&bk->lock);
+      if(b->flags & B_VALID)
+        bcache.nevict++;
       return b;
     }
+    release(&bk->lock);
+  }
+}
+
+// Look through buffer cache for block on device dev.
+// If not found, allocate a buffer.
+// In either case, return locked buffer.
+static struct buf*
+bget(uint dev, uint blockno)
+{
+  struct bucket *bk;
+  struct buf *b;
+
+  bk = bucket(dev, blockno);
+  acquire(&bk->lock);
+  b = bfind(bk, dev, blockno);
+  release(&bk->lock);
+  if(b){
+    acquiresleep(&b->lock);
+    return b;
+  }
+
+  // Not cached; recycle an unused buffer.  Another miss on the
+  // same block may have got in first.
+  acquire(&bcache.evictlock);
+  acquire(&bk->lock);
+  b = bfind(bk, dev, blockno);
+  release(&bk->lock);
+  if(b == 0){
+    bcache.nmiss++;
+    b = evict();
+    b->dev = dev;
+    b->blockno = blockno;
+    b->flags = 0;
+    b->refcnt = 1;
+    acquire(&bk->lock);
+    b->hnext = bk->head;
+    bk->head = b;
+    release(&bk->lock);
   }
-  panic("bget: no buffers");
+  release(&bcache.evictlock);
+  acquiresleep(&b->lock);
+  return b;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -100,6 +265,7 @@ bread(uint dev, uint blockno)
 
   b = bget(dev, blockno);
   if((b->flags & B_VALID) == 0) {
+    atomicinc(&bcache.nread);
     iderw(b);
   }
   return b;
@@ -112,33 +278,134 @@ bwrite(struct buf *b)
   if(!holdingsleep(&b->lock))
     panic("bwrite");
   b->flags |= B_DIRTY;
+  atomicinc(&bcache.nwrite);
   iderw(b);
 }
 
+// Start writing b's contents to disk and return without
+// waiting.  Must be locked, and stay locked until bwaitany()
+// or bwaitall() says the write is done.
+void
+bwritestart(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bwritestart");
+  b->flags |= B_DIRTY;
+  atomicinc(&bcache.nwrite);
+  idesubmit(b);
+}
+
+// Wait for the disk to finish one of the n buffers in bs
+// started by bwritestart(), and return its index.
+int
+bwaitany(struct buf **bs, int n)
+{
+  return idewaitany(bs, n);
+}
+
+// Wait for the disk to finish all n buffers in bs.
+void
+bwaitall(struct buf **bs, int n)
+{
+  idewaitall(bs, n);
+}
+
+// Start reading blockno into the cache, if it is not there
+// already, and return without waiting for the disk.  Gives
+// up rather than take one of the last NBUF free buffers,
+// which readers that must wait need more.
+void
+breadahead(uint dev, uint blockno)
+{
+  struct bucket *bk;
+  struct buf *b;
+
+  bk = bucket(dev, blockno);
+  acquire(&bcache.evictlock);
+  acquire(&bk->lock);
+  for(b = bk->head; b; b = b->hnext)
+    if(b->dev == dev && b->blockno == blockno)
+      break;
+  release(&bk->lock);
+  if(b || bcache.nfree <= NBUF){
+    release(&bcache.evictlock);
+    return;
+  }
+  b = evict();
+  b->dev = dev;
+  b->blockno = blockno;
+  b->flags = B_ASYNC;
+  b->refcnt = 1;
+  // Lock b before anyone can find it, so that a reader
+  // waits for the disk.  No one holds it, so this does not
+  // sleep.
+  acquiresleep(&b->lock);
+  acquire(&bk->lock);
+  b->hnext = bk->head;
+  bk->head = b;
+  release(&bk->lock);
+  bcache.nreadahead++;
+  release(&bcache.evictlock);
+  atomicinc(&bcache.nread);
+  idesubmit(b);
+}
+
+// Drop a reference to b, whose lock the caller has released.
+static void
+bput(struct buf *b)
+{
+  struct bucket *bk;
+
+  bk = bucket(b->dev, b->blockno);
+  acquire(&bk->lock);
+  b->refcnt--;
+  if (b->refcnt == 0) {
+    // no one is waiting for it.
+    freebuf(b);
+  }
+  release(&bk->lock);
+}
+
 // Release a locked buffer.
-// Move to the head of the MRU list.
+// Move to the head of the free list if no one else holds it.
 void
 brelse(struct buf *b)
 {
   if(!holdingsleep(&b->lock))
     panic("brelse");
+  releasesleep(&b->lock);
+  bput(b);
+}
 
+// Finish a read started by breadahead(), on behalf of the
+// process that started it.  Called by the disk driver.
+void
+bdone(struct buf *b)
+{
   releasesleep(&b->lock);
+  bput(b);
+}
 
-  acquire(&bcache.lock);
-  b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+// Fill in the buffer cache statistics.
+void
+bstat(struct kbufstat *st)
+{
+  struct bucket *bk;
+
+  st->nbuf = bcache.nbuf;
+  st->nhit = 0;
+  for(bk = buckets; bk < &buckets[NBUCKET]; bk++){
+    acquire(&bk->lock);
+    st->nhit += bk->nhit;
+    release(&bk->lock);
   }
-  
-  release(&bcache.lock);
+  acquire(&bcache.evictlock);
+  st->nmiss = bcache.nmiss;
+  st->nevict = bcache.nevict;
+  st->nreadahead = bcache.nreadahead;
+  release(&bcache.evictlock);
+  st->nread = bcache.nread;
+  st->nwrite = bcache.nwrite;
 }
 //PAGEBREAK!
 // Blank page.
-
@@ -4,11 +4,18 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
+  struct buf *prev; // LRU free list
   struct buf *next;
-  struct buf *qnext; // disk queue
+  struct buf *hnext; // hash bucket chain
+  struct buf *qleft; // disk queue heap
+  struct buf *qright;
+  int qrank;
+  struct buf *qnext; // rest of the disk's active run
+  uint tsubmit;      // rdtsc() when queued for the disk
+  uint tstart;       // rdtsc() when the disk started on it
   uchar data[BSIZE];
 };
 #define B_VALID 0x2  // buffer has been read from disk
 #define B_DIRTY 0x4  // buffer needs to be written to disk
+#define B_ASYNC 0x8  // read-ahead; the disk interrupt calls bdone()
 
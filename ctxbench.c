@@ -0,0 +1,84 @@
+// Measure context switches between two processes, which have
+// different page tables, and between two threads, which share
+// one: each round trip passes a byte there and back through a
+// pair of pipes.  Also reports how many of the switches had to
+// reload %cr3 and so flush the TLB.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "kstat.h"
+
+#define N 2000
+
+int ping[2], pong[2];
+
+void
+echo(void)
+{
+  char c;
+  int i;
+
+  for(i = 0; i < N; i++){
+    read(ping[0], &c, 1);
+    write(pong[1], &c, 1);
+  }
+}
+
+void
+threadecho(void *arg1, void *arg2)
+{
+  echo();
+  exit();
+}
+
+void
+bench(char *how, int usethread)
+{
+  struct kswitchstat s0, s1;
+  uint t0, t1;
+  char c;
+  int i;
+
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    printf(1, "pipe failed\n");
+    exit();
+  }
+  kswitchstat(&s0);
+  t0 = rdtsc();
+  if(usethread){
+    if(thread_create(threadecho, 0, 0) < 0){
+      printf(1, "thread_create failed\n");
+      exit();
+    }
+  } else if(fork() == 0){
+    echo();
+    exit();
+  }
+  c = 'x';
+  for(i = 0; i < N; i++){
+    write(ping[1], &c, 1);
+    read(pong[0], &c, 1);
+  }
+  t1 = rdtsc();
+  kswitchstat(&s1);
+  if(usethread)
+    thread_join();
+  else
+    wait(0, 0, 0);
+  printf(1, "%s: %d cycles per round trip, %d switches, %d cr3 loads\n",
+         how, (t1 - t0) / N, s1.nswitch - s0.nswitch, s1.ncr3 - s0.ncr3);
+  close(ping[0]);
+  close(ping[1]);
+  close(pong[0]);
+  close(pong[1]);
+}
+
+int
+main(int argc, char *argv[])
+{
+  bench("processes", 0);
+  bench("threads", 1);
+  exit();
+}
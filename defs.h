@@ -2,19 +2,32 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct kmemcache;
+struct kmemstat;
+struct kswitchstat;
+struct kbufstat;
+struct kdiskstat;
 struct pipe;
 struct proc;
 struct rtcdate;
 struct spinlock;
 struct sleeplock;
 struct stat;
+struct shmseg;
 struct superblock;
+struct vma;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bstat(struct kbufstat*);
+void            breadahead(uint, uint);
+void            bdone(struct buf*);
+void            bwritestart(struct buf*);
+int             bwaitany(struct buf**, int);
+void            bwaitall(struct buf**, int);
 
 // console.c
 void            consoleinit(void);
@@ -24,6 +37,8 @@ void            panic(char*) __attribute__((noreturn));
 
 // exec.c
 int             exec(char*, char**);
+pde_t*          loadimage(char*, char**, uint*, uint*, uint*);
+void            setprocname(struct proc*, char*);
 
 // file.c
 struct file*    filealloc(void);
@@ -50,13 +65,34 @@ int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, char*, uint, uint);
+void            readahead(struct file*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 
+// futex.c
+void            futexinit(void);
+int             futexwait(uint, uint);
+int             futexwake(uint, int);
+
+// highmem.c
+extern uint     phystop;
+uint            highalloc(void);
+void            highfree(uint);
+void            highstat(struct kmemstat*);
+void            meminit(void);
+char*           tmpmap(uint);
+void            tmpmapinit(pde_t*);
+void            tmpunmap(char*);
+
 // ide.c
 void            ideinit(void);
 void            ideintr(void);
 void            iderw(struct buf*);
+void            idesubmit(struct buf*);
+int             idewaitany(struct buf**, int);
+void            idewaitall(struct buf**, int);
+void            idestats(struct kdiskstat*);
+int             ideswapsize(void);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
@@ -65,9 +101,17 @@ void            ioapicinit(void);
 
 // kalloc.c
 char*           kalloc(void);
+char*           kallocpages(int);
 void            kfree(char*);
+void            kfreepages(char*, int);
+void            kmemstat(struct kmemstat*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+void            kincref(char*);
+int             krefcount(char*);
+int             kunshare(char*);
+char*           kzalloc(void);
+void            kzrefill(void);
 
 // kbd.c
 void            kbdintr(void);
@@ -91,11 +135,30 @@ void            end_op();
 extern int      ismp;
 void            mpinit(void);
 
+// mmap.c
+struct vma*     findvma(struct proc*, uint);
+int             mmap(struct file*, uint, int, int, uint);
+int             munmap(uint, uint);
+uint            vmabase(struct proc*);
+int             vmacheck(uint, uint, int);
+int             vmadup(struct proc*, struct proc*);
+int             vmafault(struct proc*, uint, int);
+struct vma*     vmaalloc(struct proc*, uint);
+void            vmaunmap(struct proc*, struct vma*);
+void            vmaunmapall(struct proc*);
+
+// pcache.c
+void            pcinit(void);
+char*           pcget(struct inode*, uint);
+void            pcinval(struct inode*);
+void            pcupdate(struct inode*, uint, char*, uint);
+
 // picirq.c
 void            picenable(int);
 void            picinit(void);
 
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
@@ -103,10 +166,14 @@ int             pipewrite(struct pipe*, char*, int);
 
 //PAGEBREAK: 16
 // proc.c
+int             clone(uint, uint, uint, uint);
 int             cpuid(void);
+pde_t*          evictpage(uint, uint*);
 void            exit(void);
 int             fork(void);
 int             growproc(int);
+int             join(void**);
+void            kswitchstat(struct kswitchstat*);
 int             kill(int);
 struct cpu*     mycpu(void);
 struct proc*    myproc();
@@ -115,6 +182,8 @@ void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            setproc(struct proc*);
+int             sharedpgdir(struct proc*);
+int             spawn(char*, char**, int*);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(int * , int * ,int *);
@@ -136,6 +205,21 @@ int             changeMultiFlag(int);
 // swtch.S
 void            swtch(struct context**, struct context*);
 
+// shm.c
+void            shminit(void);
+int             shmat(int);
+int             shmdt(uint);
+void            shmdup(struct shmseg*);
+int             shmget(int, uint);
+int             shmrm(int);
+char*           shmpage(struct shmseg*, uint);
+void            shmput(struct shmseg*);
+
+// slab.c
+void            kmcacheinit(struct kmemcache*, char*, uint);
+void*           kmcalloc(struct kmemcache*);
+void            kmcfree(struct kmemcache*, void*);
+
 // spinlock.c
 void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
@@ -160,9 +244,18 @@ int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 
+// swap.c
+void            reclaim(int);
+int             swapcheck(uint, uint);
+int             swapfault(struct proc*, uint);
+void            swapfree(uint);
+void            swapinit(void);
+void            swapread(uint, uint);
+void            swapstat(struct kmemstat*);
+
 // syscall.c
 int             argint(int, int*);
-int             argptr(int, char**, int);
+int             argptr(int, char**, int, int);
 int             argstr(int, char**);
 int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
@@ -187,17 +280,25 @@ void            uartputc(int);
 void            seginit(void);
 void            kvmalloc(void);
 pde_t*          setupkvm(void);
-char*           uva2ka(pde_t*, char*);
+uint            uva2pa(pde_t*, char*);
 int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
+uint            unmapuvm(pde_t*, uint, uint, pte_t*, int, int*);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
+void            switchkvmidle(void);
 int             copyout(pde_t*, uint, void*, uint);
+int             allocvproc(pde_t*);
+void            setvproc(pde_t*, int, int);
+uint            ualloc(void);
+void            ufree(uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+int             mappages(pde_t*, void*, uint, uint, int);
+pte_t*          walkpgdir(pde_t*, const void*, int);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
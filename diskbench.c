@@ -0,0 +1,54 @@
+// Disk throughput: write a scratch file of n blocks (default
+// 400) through the log, then print the rate and the cycles the
+// IDE driver spent per MB it moved, which is what DMA saves
+// over PIO.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "kstat.h"
+
+#define CHUNK 8   // blocks per write()
+
+char buf[CHUNK*512];
+
+int
+main(int argc, char *argv[])
+{
+  struct kdiskstat s0, s1;
+  int fd, i, n, k;
+  uint t0, t, nsect;
+
+  n = argc > 1 ? atoi(argv[1]) : 400;
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = i;
+  kdiskstat(&s0);
+  t0 = uptime();
+  if((fd = open("diskbench.tmp", O_CREATE|O_WRONLY)) < 0){
+    printf(1, "diskbench: cannot create diskbench.tmp\n");
+    exit();
+  }
+  for(i = 0; i < n; i += k){
+    k = n - i < CHUNK ? n - i : CHUNK;
+    if(write(fd, buf, k*512) != k*512){
+      printf(1, "diskbench: write failed after %d blocks\n", i);
+      break;
+    }
+  }
+  close(fd);
+  unlink("diskbench.tmp");
+  t = uptime() - t0;
+  kdiskstat(&s1);
+
+  nsect = s1.nsect - s0.nsect;
+  printf(1, "%s: %d blocks written in %d ticks", s1.dma ? "dma" : "pio", i, t);
+  if(t)
+    printf(1, ", %d KB/tick", nsect / 2 / t);
+  printf(1, "\n%d sectors moved in %d commands", nsect, s1.ncmd - s0.ncmd);
+  if(nsect)
+    printf(1, ", %d driver cycles per MB",
+           (s1.ncycles - s0.ncycles) / nsect * 2048);
+  printf(1, "\n");
+  exit();
+}
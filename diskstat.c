@@ -0,0 +1,54 @@
+// Print the disk queue statistics.  With an argument, first
+// write and sync that many blocks to a scratch file, and show
+// what the log's batched writes did to the queue.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "kstat.h"
+
+char buf[512];
+
+void
+print(struct kdiskstat *st, struct kdiskstat *s0)
+{
+  printf(1, "%d requests (%d reads, %d writes), depth %d, max depth %d\n",
+         st->nreq - s0->nreq, st->nread - s0->nread,
+         st->nwrite - s0->nwrite, st->depth, st->maxdepth);
+  printf(1, "%d disk commands\n", st->ncmd - s0->ncmd);
+  if(st->nreq != s0->nreq)
+    printf(1, "average depth at submit %d/100\n",
+           (st->sumdepth - s0->sumdepth) * 100 / (st->nreq - s0->nreq));
+  printf(1, "average cycles: %d waiting, %d in the disk\n",
+         st->avgwait, st->avgservice);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct kdiskstat s0, s1;
+  int fd, i, n;
+
+  memset(&s0, 0, sizeof(s0));
+  if(argc < 2){
+    kdiskstat(&s1);
+    print(&s1, &s0);
+    exit();
+  }
+
+  n = atoi(argv[1]);
+  kdiskstat(&s0);
+  if((fd = open("diskstat.tmp", O_CREATE|O_WRONLY)) < 0){
+    printf(1, "diskstat: cannot create diskstat.tmp\n");
+    exit();
+  }
+  for(i = 0; i < n; i++)
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf))
+      break;
+  close(fd);
+  unlink("diskstat.tmp");
+  kdiskstat(&s1);
+  print(&s1, &s0);
+  exit();
+}
@@ -0,0 +1,69 @@
+// Several processes write and then read back their own files
+// at the same time, as stressfs does, so their requests meet
+// on the disk queue.  Reports the time taken and what the
+// disk queue saw.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "x86.h"
+#include "kstat.h"
+
+#define NWRITER 4
+#define NBLOCK  100
+
+void
+writer(int i)
+{
+  char path[] = "elevbench0";
+  char data[512];
+  int fd, j;
+
+  path[9] += i;
+  memset(data, 'a' + i, sizeof(data));
+  if((fd = open(path, O_CREATE|O_RDWR)) < 0){
+    printf(1, "elevbench: cannot create %s\n", path);
+    exit();
+  }
+  for(j = 0; j < NBLOCK; j++)
+    write(fd, data, sizeof(data));
+  close(fd);
+  fd = open(path, O_RDONLY);
+  for(j = 0; j < NBLOCK; j++)
+    if(read(fd, data, sizeof(data)) != sizeof(data) || data[0] != 'a' + i){
+      printf(1, "elevbench: %s reads back wrong\n", path);
+      break;
+    }
+  close(fd);
+  unlink(path);
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct kdiskstat s0, s1;
+  uint t0, t1;
+  int i;
+
+  kdiskstat(&s0);
+  t0 = rdtsc();
+  for(i = 0; i < NWRITER; i++)
+    if(fork() == 0)
+      writer(i);
+  for(i = 0; i < NWRITER; i++)
+    wait(0, 0, 0);
+  t1 = rdtsc();
+  kdiskstat(&s1);
+
+  printf(1, "%d writers: %d cycles per block\n", NWRITER,
+         (t1 - t0) / (NWRITER * NBLOCK));
+  printf(1, "%d disk requests, max depth %d, average depth %d/100\n",
+         s1.nreq - s0.nreq, s1.maxdepth,
+         s1.nreq == s0.nreq ? 0 :
+         (s1.sumdepth - s0.sumdepth) * 100 / (s1.nreq - s0.nreq));
+  printf(1, "average cycles: %d waiting, %d in the disk\n",
+         s1.avgwait, s1.avgservice);
+  exit();
+}
@@ -7,24 +7,27 @@
 #include "x86.h"
 #include "elf.h"
 
-int
-exec(char *path, char **argv)
+// Load the program at path into a new page table, with the
+// arguments argv on its stack, for exec() and spawn().
+// Returns the page table, setting *szp to the size of the
+// image, *entryp to its entry point and *spp to its stack
+// pointer; or returns 0.
+pde_t*
+loadimage(char *path, char **argv, uint *szp, uint *entryp, uint *spp)
 {
-  char *s, *last;
   int i, off;
   uint argc, sz, sp, ustack[3+MAXARG+1];
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
-  pde_t *pgdir, *oldpgdir;
-  struct proc *curproc = myproc();
+  pde_t *pgdir;
 
   begin_op();
 
   if((ip = namei(path)) == 0){
     end_op();
     cprintf("exec: fail\n");
-    return -1;
+    return 0;
   }
   ilock(ip);
   pgdir = 0;
@@ -35,7 +38,7 @@ exec(char *path, char **argv)
   if(elf.magic != ELF_MAGIC)
     goto bad;
 
-  if((pgdir = setupkvm()) == 0)
+  if((pgdir = setupkvm()) == 0 || allocvproc(pgdir) < 0)
     goto bad;
 
   // Load program into memory.
@@ -49,6 +52,9 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
+    // Make room, swapping out other processes' pages if need be.
+    if(ph.vaddr + ph.memsz > sz)
+      reclaim(PGROUNDUP(ph.vaddr + ph.memsz - sz) / PGSIZE);
     if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
@@ -63,6 +69,7 @@ exec(char *path, char **argv)
   // Allocate two pages at the next page boundary.
   // Make the first inaccessible.  Use the second as the user stack.
   sz = PGROUNDUP(sz);
+  reclaim(2);
   if((sz = allocuvm(pgdir, sz, sz + 2*PGSIZE)) == 0)
     goto bad;
   clearpteu(pgdir, (char*)(sz - 2*PGSIZE));
@@ -87,31 +94,62 @@ exec(char *path, char **argv)
   if(copyout(pgdir, sp, ustack, (3+argc+1)*4) < 0)
     goto bad;
 
-  // Save program name for debugging.
+  *szp = sz;
+  *entryp = elf.entry;
+  *spp = sp;
+  return pgdir;
+
+ bad:
+  if(pgdir)
+    freevm(pgdir);
+  if(ip){
+    iunlockput(ip);
+    end_op();
+  }
+  return 0;
+}
+
+// Save the last element of path as p's name, for debugging.
+void
+setprocname(struct proc *p, char *path)
+{
+  char *s, *last;
+
   for(last=s=path; *s; s++)
     if(*s == '/')
       last = s+1;
-  safestrcpy(curproc->name, last, sizeof(curproc->name));
+  safestrcpy(p->name, last, sizeof(p->name));
+}
+
+int
+exec(char *path, char **argv)
+{
+  uint sz, entry, sp;
+  pde_t *pgdir, *oldpgdir;
+  struct proc *curproc = myproc();
+
+  if((pgdir = loadimage(path, argv, &sz, &entry, &sp)) == 0)
+    return -1;
+
+  // Save program name for debugging.
+  setprocname(curproc, path);
+
+  // The new image starts with no mmap() regions.
+  vmaunmapall(curproc);
 
   // Commit to the user image.
   oldpgdir = curproc->pgdir;
   curproc->pgdir = pgdir;
   curproc->sz = sz;
-  curproc->tf->eip = elf.entry;  // main
+  curproc->tf->eip = entry;  // main
   curproc->tf->esp = sp;
+  // After the commit, so that an exit() reparenting us from
+  // now on updates the new page.
+  setvproc(pgdir, curproc->pid, curproc->parent ? curproc->parent->pid : 0);
   ///alt
   //curproc->priority=
   ///
   switchuvm(curproc);
   freevm(oldpgdir);
   return 0;
-
- bad:
-  if(pgdir)
-    freevm(pgdir);
-  if(ip){
-    iunlockput(ip);
-    end_op();
-  }
-  return -1;
 }
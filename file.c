@@ -9,17 +9,24 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "slab.h"
 
 struct devsw devsw[NDEV];
+
+// File structures come from filecache; ftable.lock protects
+// their reference counts.  At most NFILE are open at once.
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
+  int nfile;
 } ftable;
 
+static struct kmemcache filecache;
+
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  kmcacheinit(&filecache, "file", sizeof(struct file));
 }
 
 // Allocate a file structure.
@@ -29,15 +36,22 @@ filealloc(void)
   struct file *f;
 
   acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
+  if(ftable.nfile >= NFILE){
+    release(&ftable.lock);
+    return 0;
   }
+  ftable.nfile++;
   release(&ftable.lock);
-  return 0;
+
+  if((f = kmcalloc(&filecache)) == 0){
+    acquire(&ftable.lock);
+    ftable.nfile--;
+    release(&ftable.lock);
+    return 0;
+  }
+  memset(f, 0, sizeof(*f));
+  f->ref = 1;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -68,7 +82,9 @@ fileclose(struct file *f)
   ff = *f;
   f->ref = 0;
   f->type = FD_NONE;
+  ftable.nfile--;
   release(&ftable.lock);
+  kmcfree(&filecache, f);
 
   if(ff.type == FD_PIPE)
     pipeclose(ff.pipe, ff.writable);
@@ -104,8 +120,10 @@ fileread(struct file *f, char *addr, int n)
     return piperead(f->pipe, addr, n);
   if(f->type == FD_INODE){
     ilock(f->ip);
-    if((r = readi(f->ip, addr, f->off, n)) > 0)
+    if((r = readi(f->ip, addr, f->off, n)) > 0){
+      readahead(f, f->off, r);
       f->off += r;
+    }
     iunlock(f->ip);
     return r;
   }
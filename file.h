@@ -6,6 +6,9 @@ struct file {
   struct pipe *pipe;
   struct inode *ip;
   uint off;
+  uint raoff;         // where the last read ended
+  uint rawin;         // read-ahead window, in blocks
+  uint raend;         // blocks below this have been read ahead
 };
 
 
@@ -0,0 +1,103 @@
+// Measure process creation cost: fork+exit+wait and
+// fork+exec+exit+wait latency, and the physical memory
+// each extra process costs.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "kstat.h"
+
+#define N 200
+
+int
+freepages(void)
+{
+  struct kmemstat st;
+
+  if(kmemstat(&st) < 0)
+    return -1;
+  return st.nfreepages;
+}
+
+void
+forkbench(void)
+{
+  uint t0, t1;
+  int i, pid;
+
+  t0 = rdtsc();
+  for(i = 0; i < N; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "fork failed\n");
+      exit();
+    }
+    if(pid == 0)
+      exit();
+    wait(0, 0, 0);
+  }
+  t1 = rdtsc();
+  printf(1, "fork+exit+wait: %d cycles\n", (t1 - t0) / N);
+}
+
+void
+execbench(char *prog)
+{
+  char *argv[] = { prog, "-x", 0 };
+  uint t0, t1;
+  int i, pid;
+
+  t0 = rdtsc();
+  for(i = 0; i < N; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      exec(prog, argv);
+      printf(1, "exec %s failed\n", prog);
+      exit();
+    }
+    wait(0, 0, 0);
+  }
+  t1 = rdtsc();
+  printf(1, "fork+exec+exit+wait: %d cycles\n", (t1 - t0) / N);
+}
+
+void
+membench(void)
+{
+  int fds[2], before, after;
+  char c;
+
+  if(pipe(fds) < 0){
+    printf(1, "pipe failed\n");
+    exit();
+  }
+  before = freepages();
+  if(fork() == 0){
+    // Stay alive until the parent has measured.
+    close(fds[1]);
+    read(fds[0], &c, 1);
+    exit();
+  }
+  after = freepages();
+  printf(1, "pages per forked process: %d\n", before - after);
+  close(fds[0]);
+  close(fds[1]);
+  wait(0, 0, 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(argc > 1 && strcmp(argv[1], "-x") == 0)
+    exit();
+
+  forkbench();
+  execbench(argv[0]);
+  membench();
+  exit();
+}
@@ -0,0 +1,65 @@
+// Fork/kill storm: create many processes at once, kill them
+// all by pid, and reap them, timing each phase; then time
+// back-to-back fork+exit+wait, which reuses reaped procs.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+
+#define N     500
+#define NLOOP 2000
+
+int pids[N];
+
+int
+main(int argc, char *argv[])
+{
+  uint t0, t1, t2, t3;
+  int i, n, pid;
+
+  n = N;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n < 1 || n > N)
+    n = N;
+
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    if((pid = fork()) < 0){
+      printf(1, "fork failed after %d\n", i);
+      n = i;
+      break;
+    }
+    if(pid == 0){
+      for(;;)
+        sleep(1000);
+    }
+    pids[i] = pid;
+  }
+  t1 = uptime();
+  for(i = 0; i < n; i++)
+    if(kill(pids[i]) < 0)
+      printf(1, "kill %d failed\n", pids[i]);
+  t2 = uptime();
+  for(i = 0; i < n; i++)
+    if(wait(0, 0, 0) < 0)
+      printf(1, "wait: missing child\n");
+  t3 = uptime();
+  printf(1, "%d processes: fork %d, kill %d, wait %d ticks\n",
+         n, t1 - t0, t2 - t1, t3 - t2);
+
+  t0 = rdtsc();
+  for(i = 0; i < NLOOP; i++){
+    if((pid = fork()) < 0){
+      printf(1, "fork failed\n");
+      exit();
+    }
+    if(pid == 0)
+      exit();
+    wait(0, 0, 0);
+  }
+  t1 = rdtsc();
+  printf(1, "fork+exit+wait: %d cycles\n", (t1 - t0) / NLOOP);
+  exit();
+}
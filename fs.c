@@ -411,6 +411,7 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a;
 
+  pcinval(ip);
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -446,6 +447,40 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+// Read ahead of a sequential reader of open file f, which
+// has just read [off, off+n) of its inode.  The window is
+// kept per open file, so readers of the same inode through
+// other files do not disturb it.  A read that starts where
+// the last one ended doubles the window, from RAMIN up to
+// RAMAX blocks; any other read closes it.  The blocks in the
+// window past this read are queued on the disk without
+// waiting, so they arrive while the caller uses this one.
+// Caller must hold f->ip->lock.
+void
+readahead(struct file *f, uint off, uint n)
+{
+  struct inode *ip = f->ip;
+  uint bn, end, nblocks;
+
+  if(ip->type == T_DEV || n == 0)
+    return;
+  if(off == f->raoff)
+    f->rawin = f->rawin ? min(2*f->rawin, RAMAX) : RAMIN;
+  else
+    f->rawin = f->raend = 0;
+  f->raoff = off + n;
+
+  bn = (off + n + BSIZE - 1) / BSIZE;
+  nblocks = (ip->size + BSIZE - 1) / BSIZE;
+  end = min(bn + f->rawin, nblocks);
+  if(bn < f->raend)
+    bn = f->raend;
+  for(; bn < end; bn++)
+    breadahead(ip->dev, bmap(ip, bn));
+  if(end > f->raend)
+    f->raend = end;
+}
+
 //PAGEBREAK!
 // Read data from inode.
 // Caller must hold ip->lock.
@@ -501,6 +536,8 @@ writei(struct inode *ip, char *src, uint off, uint n)
     memmove(bp->data + off%BSIZE, src, m);
     log_write(bp);
     brelse(bp);
+    if(ip->type == T_FILE)
+      pcupdate(ip, off, src, m);
   }
 
   if(n > 0 && off > ip->size){
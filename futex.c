@@ -0,0 +1,132 @@
+// Futexes: sleeping on a word of user memory.
+//
+// futexwait(addr, val) sleeps if the word at addr still holds
+// val, and futexwake(addr, n) wakes up to n sleepers on addr.
+// Waiters are keyed by the word's physical address, so threads
+// sharing a page table and processes sharing a shm segment meet
+// on the same key.  Each waiter queues itself in a hash bucket
+// and sleeps on its own queue entry, so a wake can pick exactly
+// n of them.  The bucket lock is held from the value check to
+// sleep(), so a wake between the two is not lost.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+
+#define NFUTEXHASH 31
+
+struct futexwaiter {
+  uint key;
+  int woken;
+  struct futexwaiter *next;
+};
+
+struct {
+  struct spinlock lock;
+  struct futexwaiter *head;
+} futextable[NFUTEXHASH];
+
+void
+futexinit(void)
+{
+  int i;
+
+  for(i = 0; i < NFUTEXHASH; i++)
+    initlock(&futextable[i].lock, "futex");
+}
+
+// Return the physical address of the word at user address
+// addr in the current process, or 0 if addr is not mapped
+// or not aligned.
+static uint
+futexkey(uint addr)
+{
+  pte_t *pte;
+
+  if(addr % 4 || addr >= KERNBASE)
+    return 0;
+  pte = walkpgdir(myproc()->pgdir, (char*)addr, 0);
+  if(pte == 0 || (*pte & PTE_P) == 0 || (*pte & PTE_U) == 0)
+    return 0;
+  return PTE_ADDR(*pte) | (addr % PGSIZE);
+}
+
+static void
+dequeue(struct futexwaiter **pp, struct futexwaiter *w)
+{
+  for(; *pp; pp = &(*pp)->next){
+    if(*pp == w){
+      *pp = w->next;
+      return;
+    }
+  }
+}
+
+// Sleep until woken by futexwake(), if the word at addr
+// still holds val.  The caller has checked that addr is
+// in the process's memory.  Returns 0 when woken, or -1
+// if the word had changed or the process was killed.
+int
+futexwait(uint addr, uint val)
+{
+  struct futexwaiter w;
+  uint key, h;
+
+  if((key = futexkey(addr)) == 0)
+    return -1;
+  h = key % NFUTEXHASH;
+  acquire(&futextable[h].lock);
+  // The word may be in high memory; read it through the
+  // current page table.
+  if(*(uint*)addr != val){
+    release(&futextable[h].lock);
+    return -1;
+  }
+  w.key = key;
+  w.woken = 0;
+  w.next = futextable[h].head;
+  futextable[h].head = &w;
+  while(!w.woken){
+    if(myproc()->killed){
+      dequeue(&futextable[h].head, &w);
+      release(&futextable[h].lock);
+      return -1;
+    }
+    sleep(&w, &futextable[h].lock);
+  }
+  release(&futextable[h].lock);
+  return 0;
+}
+
+// Wake up to n processes sleeping on the word at addr.
+// Returns the number woken.
+int
+futexwake(uint addr, int n)
+{
+  struct futexwaiter **pp, *w;
+  uint key, h;
+  int woken;
+
+  if((key = futexkey(addr)) == 0)
+    return -1;
+  h = key % NFUTEXHASH;
+  woken = 0;
+  acquire(&futextable[h].lock);
+  for(pp = &futextable[h].head; *pp && woken < n; ){
+    w = *pp;
+    if(w->key != key){
+      pp = &w->next;
+      continue;
+    }
+    *pp = w->next;
+    w->woken = 1;
+    wakeup(w);
+    woken++;
+  }
+  release(&futextable[h].lock);
+  return woken;
+}
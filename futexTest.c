@@ -0,0 +1,105 @@
+// Exercise the futex-based mutex and condition variable:
+// threads bump a shared counter under a mutex, then pass
+// items through a bounded queue.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NTHREAD 4
+#define NITER   20000
+#define QSIZE   8
+#define NITEM   2000
+
+mutex_t m;
+volatile int counter;
+
+cond_t notempty, notfull;
+int queue[QSIZE];
+int head, tail;
+volatile int consumed;
+
+void
+fail(char *what)
+{
+  printf(1, "futexTest: %s\n", what);
+  exit();
+}
+
+void
+bump(void *arg1, void *arg2)
+{
+  int i;
+
+  for(i = 0; i < NITER; i++){
+    mutex_lock(&m);
+    counter++;
+    mutex_unlock(&m);
+  }
+  exit();
+}
+
+void
+producer(void *arg1, void *arg2)
+{
+  int i;
+
+  for(i = 1; i <= NITEM; i++){
+    mutex_lock(&m);
+    while(head - tail == QSIZE)
+      cond_wait(&notfull, &m);
+    queue[head++ % QSIZE] = i;
+    cond_signal(&notempty);
+    mutex_unlock(&m);
+  }
+  exit();
+}
+
+void
+consumer(void *arg1, void *arg2)
+{
+  int i;
+
+  for(i = 1; i <= NITEM; i++){
+    mutex_lock(&m);
+    while(head == tail)
+      cond_wait(&notempty, &m);
+    if(queue[tail++ % QSIZE] != i)
+      fail("queue out of order");
+    consumed++;
+    cond_signal(&notfull);
+    mutex_unlock(&m);
+  }
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i;
+  uint t0;
+
+  mutex_init(&m);
+  t0 = uptime();
+  for(i = 0; i < NTHREAD; i++)
+    if(thread_create(bump, 0, 0) < 0)
+      fail("thread_create");
+  while(thread_join() >= 0)
+    ;
+  if(counter != NTHREAD * NITER)
+    fail("lost increments");
+  printf(1, "mutex: %d increments in %d ticks\n", counter, uptime() - t0);
+
+  cond_init(&notempty);
+  cond_init(&notfull);
+  t0 = uptime();
+  if(thread_create(producer, 0, 0) < 0 || thread_create(consumer, 0, 0) < 0)
+    fail("thread_create");
+  while(thread_join() >= 0)
+    ;
+  if(consumed != NITEM)
+    fail("lost items");
+  printf(1, "cond: %d items in %d ticks\n", consumed, uptime() - t0);
+  printf(1, "futexTest ok\n");
+  exit();
+}
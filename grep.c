@@ -3,16 +3,44 @@
 #include "types.h"
 #include "stat.h"
 #include "user.h"
+#include "fcntl.h"
 
 char buf[1024];
 int match(char*, char*);
 
+// Search a file in place, if it can be mapped, instead of
+// copying it through buf.  Returns -1 if fd cannot be mapped.
+int
+grepmap(char *pattern, int fd)
+{
+  struct stat st;
+  char *map, *p, *q;
+
+  if(fstat(fd, &st) < 0 || st.type != T_FILE || st.size == 0)
+    return -1;
+  if((map = mmap(0, st.size, PROT_READ, MAP_PRIVATE, fd, 0)) == (char*)-1)
+    return -1;
+  for(p = map; p < map + st.size; p = q+1){
+    for(q = p; q < map + st.size && *q != '\n'; q++)
+      ;
+    if(q == map + st.size)
+      break;  // like the read loop, skip an unterminated last line
+    if(match(pattern, p))
+      write(1, p, q+1 - p);
+  }
+  munmap(map, st.size);
+  return 0;
+}
+
 void
 grep(char *pattern, int fd)
 {
   int n, m;
   char *p, *q;
 
+  if(grepmap(pattern, fd) == 0)
+    return;
+
   m = 0;
   while((n = read(fd, buf+m, sizeof(buf)-m-1)) > 0){
     m += n;
@@ -65,6 +93,9 @@ main(int argc, char *argv[])
 
 // Regexp matcher from Kernighan & Pike,
 // The Practice of Programming, Chapter 9.
+// Text ends at '\0' or, for lines of a mapped file, at '\n'.
+
+#define EOL(c) ((c) == '\0' || (c) == '\n')
 
 int matchhere(char*, char*);
 int matchstar(int, char*, char*);
@@ -77,7 +108,7 @@ match(char *re, char *text)
   do{  // must look at empty string
     if(matchhere(re, text))
       return 1;
-  }while(*text++ != '\0');
+  }while(!EOL(*text++));
   return 0;
 }
 
@@ -89,8 +120,8 @@ int matchhere(char *re, char *text)
   if(re[1] == '*')
     return matchstar(re[0], re+2, text);
   if(re[0] == '$' && re[1] == '\0')
-    return *text == '\0';
-  if(*text!='\0' && (re[0]=='.' || re[0]==*text))
+    return EOL(*text);
+  if(!EOL(*text) && (re[0]=='.' || re[0]==*text))
     return matchhere(re+1, text+1);
   return 0;
 }
@@ -101,7 +132,7 @@ int matchstar(int c, char *re, char *text)
   do{  // a * matches zero or more instances
     if(matchhere(re, text))
       return 1;
-  }while(*text!='\0' && (*text++==c || c=='.'));
+  }while(!EOL(*text) && (*text++==c || c=='.'));
   return 0;
 }
 
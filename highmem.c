@@ -0,0 +1,217 @@
+// Physical memory above the direct map.
+//
+// meminit() reads the BIOS memory map that bootasm.S saved at
+// E820MAP.  The kernel maps physical memory directly at
+// KERNBASE only up to phystop (at most DIRECTMAX), for kalloc()
+// and everything the kernel itself uses.  Usable memory above
+// phystop and below 4GB is "high memory": it backs user pages
+// (see ualloc() in vm.c), and the kernel reaches a high page
+// only through a temporary mapping made by tmpmap().
+//
+// Free high pages form a list linked through their first
+// word, and pages never used yet are handed out from the
+// BIOS ranges in order.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "kstat.h"
+
+#define E820MAX   32  // entries bootasm.S may have stored
+#define E820RAM   1   // usable memory
+#define NHIGH     8   // ranges of high memory
+#define TMPSLOTS  2   // temporary mappings per CPU
+
+struct e820entry {
+  uint addr;
+  uint addrhi;
+  uint len;
+  uint lenhi;
+  uint type;
+};
+
+uint phystop;         // end of directly mapped physical memory
+
+struct {
+  struct spinlock lock;
+  uint start[NHIGH];  // unused part of each range
+  uint end[NHIGH];
+  int nrange;
+  uint free;          // first free page, or 0
+  uint npages;
+  uint nfree;
+} high;
+
+static pte_t *tmpmappte;  // PTEs for the tmpmap() window
+
+static void
+addhigh(uint start, uint end)
+{
+  start = PGROUNDUP(start);
+  end = PGROUNDDOWN(end);
+  if(start >= end || high.nrange == NHIGH)
+    return;
+  high.start[high.nrange] = start;
+  high.end[high.nrange] = end;
+  high.nrange++;
+  high.npages += (end - start) / PGSIZE;
+  high.nfree += (end - start) / PGSIZE;
+}
+
+// Find the size of physical memory.  Called before kvmalloc(),
+// while entrypgdir still maps the low 4MB.
+void
+meminit(void)
+{
+  struct e820entry *e;
+  uint n, start, end, top;
+  int i;
+
+  initlock(&high.lock, "highmem");
+  phystop = PHYSTOP;
+  n = *(ushort*)P2V(E820MAP) / sizeof(struct e820entry);
+  if(n == 0 || n > E820MAX)
+    return;
+
+  // The direct map ends where the usable range holding
+  // the kernel does, or at DIRECTMAX.
+  e = (struct e820entry*)P2V(E820MAP + 4);
+  top = 0;
+  for(i = 0; i < n; i++){
+    if(e[i].type != E820RAM || e[i].addrhi != 0)
+      continue;
+    end = e[i].addr + e[i].len;
+    if(e[i].lenhi != 0 || end < e[i].addr)
+      end = 0xFFFFF000;  // runs past 4GB
+    if(e[i].addr <= EXTMEM && EXTMEM < end)
+      top = end;
+  }
+  if(top < 4*1024*1024)
+    return;
+  phystop = PGROUNDDOWN(top < DIRECTMAX ? top : DIRECTMAX);
+
+  for(i = 0; i < n; i++){
+    if(e[i].type != E820RAM || e[i].addrhi != 0)
+      continue;
+    start = e[i].addr;
+    end = e[i].addr + e[i].len;
+    if(e[i].lenhi != 0 || end < e[i].addr)
+      end = 0xFFFFF000;
+    if(start < phystop)
+      start = phystop;
+    addhigh(start, end);
+  }
+}
+
+// Set up the tmpmap() window's page table in kpgdir, before
+// setupkvm() starts copying kpgdir's kernel entries.
+void
+tmpmapinit(pde_t *pgdir)
+{
+  if((tmpmappte = walkpgdir(pgdir, (char*)TMPMAPBASE, 1)) == 0)
+    panic("tmpmapinit");
+  if(NCPU*TMPSLOTS > PTX(VDATA))
+    panic("tmpmapinit: slots");
+}
+
+// Return a kernel address for the physical page pa.  Directly
+// mapped pages need nothing more; a high page is mapped into
+// one of this CPU's slots.  Interrupts stay off until the
+// matching tmpunmap(), so the caller must not sleep.
+char*
+tmpmap(uint pa)
+{
+  struct cpu *c;
+  uint va;
+  int slot;
+
+  if(pa < phystop)
+    return P2V(pa);
+  pushcli();
+  c = mycpu();
+  if(c->ntmpmap >= TMPSLOTS)
+    panic("tmpmap");
+  slot = (c - cpus) * TMPSLOTS + c->ntmpmap++;
+  va = TMPMAPBASE + slot*PGSIZE;
+  tmpmappte[slot] = PGROUNDDOWN(pa) | PTE_P | PTE_W;
+  invlpg((void*)va);
+  return (char*)va;
+}
+
+// Undo the most recent tmpmap() on this CPU.
+void
+tmpunmap(char *v)
+{
+  struct cpu *c;
+  int slot;
+
+  if((uint)v < TMPMAPBASE)
+    return;
+  c = mycpu();
+  slot = (c - cpus) * TMPSLOTS + --c->ntmpmap;
+  if(TMPMAPBASE + slot*PGSIZE != PGROUNDDOWN((uint)v))
+    panic("tmpunmap");
+  tmpmappte[slot] = 0;
+  invlpg(v);
+  popcli();
+}
+
+// Allocate a page of high memory and return its physical
+// address, or 0 if there is none.  The contents are undefined.
+uint
+highalloc(void)
+{
+  uint pa;
+  int i;
+  char *v;
+
+  acquire(&high.lock);
+  if((pa = high.free) != 0){
+    v = tmpmap(pa);
+    high.free = *(uint*)v;
+    tmpunmap(v);
+  } else {
+    for(i = 0; i < high.nrange; i++){
+      if(high.start[i] < high.end[i]){
+        pa = high.start[i];
+        high.start[i] += PGSIZE;
+        break;
+      }
+    }
+  }
+  if(pa)
+    high.nfree--;
+  release(&high.lock);
+  return pa;
+}
+
+void
+highfree(uint pa)
+{
+  char *v;
+
+  if(pa % PGSIZE || pa < phystop)
+    panic("highfree");
+  acquire(&high.lock);
+  v = tmpmap(pa);
+  *(uint*)v = high.free;
+  tmpunmap(v);
+  high.free = pa;
+  high.nfree++;
+  release(&high.lock);
+}
+
+// Fill in the high memory part of the allocator statistics.
+void
+highstat(struct kmemstat *st)
+{
+  acquire(&high.lock);
+  st->nhighpages = high.npages;
+  st->nfreehigh = high.nfree;
+  release(&high.lock);
+}
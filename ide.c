@@ -1,4 +1,6 @@
-// Simple PIO-based (non-DMA) IDE driver code.
+// Simple IDE driver code.  Data moves by bus-master DMA when
+// the PCI IDE controller (a PIIX in QEMU) offers it, and by
+// PIO through the data port otherwise.
 
 #include "types.h"
 #include "defs.h"
@@ -12,6 +14,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "kstat.h"
 
 #define SECTOR_SIZE   512
 #define IDE_BSY       0x80
@@ -23,16 +26,87 @@
 #define IDE_CMD_WRITE 0x30
 #define IDE_CMD_RDMUL 0xc4
 #define IDE_CMD_WRMUL 0xc5
+#define IDE_CMD_SETMUL 0xc6
+#define IDE_CMD_IDENT 0xec
+#define IDE_CMD_RDDMA 0xc8
+#define IDE_CMD_WRDMA 0xca
 
-// idequeue points to the buf now being read/written to the disk.
-// idequeue->qnext points to the next buf to be processed.
+// PCI configuration space.
+#define PCI_CONFADDR  0xcf8
+#define PCI_CONFDATA  0xcfc
+#define PCI_CMD       0x04   // command register
+#define PCI_CLASS     0x08   // class, subclass, programming interface
+#define PCI_BAR4      0x20   // IDE bus-master registers
+#define PCI_CMD_IO    0x01
+#define PCI_CMD_BM    0x04
+
+// Bus-master IDE registers for the primary channel,
+// relative to BAR4.
+#define BM_CMD        0
+#define BM_STATUS     2
+#define BM_PRDT       4
+#define BM_START      0x01
+#define BM_READ       0x08   // the controller writes memory
+#define BM_ERR        0x02
+#define BM_INTR       0x04
+
+// Physical region descriptor: one piece of memory for DMA.
+// A piece must not cross a 64KB boundary; pieces here never
+// cross a page boundary.
+struct prd {
+  uint addr;
+  ushort len;
+  ushort flags;
+};
+#define PRD_EOT       0x8000  // last descriptor in the table
+
+#define IDEMULT    16   // sectors per interrupt for READ/WRITE MULTIPLE
+#define IDEMAXSECT 128  // sectors per command
+
+// idecur points to the buf now being read/written to the disk.
+// The requests waiting behind it are kept in C-LOOK (elevator)
+// order in two leftist heaps keyed by (dev, blockno): the disk
+// works upward through sweep, and a request below the current
+// one waits in nextsweep for the following pass.  Once SWEEPLATE
+// requests have joined the sweep after it began, later ones
+// wait for the next pass too, so a stream of requests just
+// ahead of the head cannot starve the rest.
+//
+// idestart() takes the queued requests for the blocks right
+// after idecur along into one command, chained through qnext.
+// By DMA the controller moves the whole run, described in
+// prdt, and interrupts at the end.  By PIO the data moves
+// IDEMULT sectors per interrupt (or one, if the drive refused
+// SET MULTIPLE MODE); idexfer and idesect say where in the run
+// the next sector goes, and every buf wholly before idexfer
+// is done.
 // You must hold idelock while manipulating queue.
 
+#define SWEEPLATE 64
+
 static struct spinlock idelock;
-static struct buf *idequeue;
+static struct buf *idecur;
+static struct buf *idexfer;
+static int idesect;
+static struct buf *sweep;
+static struct buf *nextsweep;
+static int nlate;          // requests that joined sweep after it began
 
 static int havedisk1;
+static int idemult[2];     // sectors per interrupt, or 0 without multiple mode
+static uint swapsize;      // blocks of swap area that fit on disk SWAPDEV
+static ushort bmiba;       // bus-master registers, or 0
+static int idedma;         // use DMA
+static struct prd *prdt;   // one page of descriptors for the active run
 static void idestart(struct buf*);
+static void idecmd(void);
+static int idesetmult(int);
+static uint idesize(int);
+static int dmainit(void);
+static struct buf *qmerge(struct buf*, struct buf*);
+
+static struct kdiskstat idestat;  // guarded by idelock
+static int nwaitany;              // sleepers in idewaitany()
 
 // Wait for IDE disk to become ready.
 static int
@@ -65,80 +139,404 @@ ideinit(void)
     }
   }
 
+  // Move IDEMULT sectors per interrupt on multi-sector
+  // commands.  Keep the disk quiet while setting it up.
+  outb(0x3f6, 2);
+  idemult[0] = idesetmult(0);
+  if(havedisk1)
+    idemult[1] = idesetmult(1);
+
+  // Use only as much of the swap area as the disk holds.
+  swapsize = idesize(SWAPDEV);
+  if(swapsize <= SWAPSTART)
+    swapsize = 0;
+  else if((swapsize -= SWAPSTART) > SWAPSIZE)
+    swapsize = SWAPSIZE;
+  if(swapsize < SWAPSIZE)
+    cprintf("ide: disk %d has room for %d of %d swap blocks\n",
+            SWAPDEV, swapsize, SWAPSIZE);
+
   // Switch back to disk 0.
   outb(0x1f6, 0xe0 | (0<<4));
+
+  if(dmainit() == 0)
+    idedma = 1;
+}
+
+static uint
+pciread(int dev, int func, int reg)
+{
+  outl(PCI_CONFADDR, 0x80000000 | (dev<<11) | (func<<8) | reg);
+  return inl(PCI_CONFDATA);
+}
+
+static void
+pciwrite(int dev, int func, int reg, uint v)
+{
+  outl(PCI_CONFADDR, 0x80000000 | (dev<<11) | (func<<8) | reg);
+  outl(PCI_CONFDATA, v);
+}
+
+// Find a bus-master IDE controller on PCI bus 0 whose primary
+// channel is at the legacy ports, and let it master the bus.
+// Returns 0, or -1 if there is none and the disk must use PIO.
+static int
+dmainit(void)
+{
+  int dev, func;
+  uint class, bar;
+
+  for(dev = 0; dev < 32; dev++){
+    for(func = 0; func < 8; func++){
+      if((pciread(dev, func, 0) & 0xffff) == 0xffff)
+        continue;
+      class = pciread(dev, func, PCI_CLASS) >> 8;
+      if((class >> 8) != 0x0101 || (class & 0x80) == 0 || (class & 0x01))
+        continue;
+      bar = pciread(dev, func, PCI_BAR4);
+      if((bar & 1) == 0 || (bar & 0xfffc) == 0)
+        continue;
+      if((prdt = (struct prd*)kalloc()) == 0)
+        return -1;
+      pciwrite(dev, func, PCI_CMD,
+               pciread(dev, func, PCI_CMD) | PCI_CMD_IO | PCI_CMD_BM);
+      bmiba = bar & 0xfffc;
+      outb(bmiba+BM_CMD, 0);
+      outb(bmiba+BM_STATUS, BM_INTR|BM_ERR);
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// Describe the buffers of the active run to the controller,
+// a page-bounded piece at a time.
+static void
+prdfill(void)
+{
+  struct buf *b;
+  struct prd *p;
+  uint a, end, n;
+
+  p = prdt;
+  for(b = idecur; b != 0; b = b->qnext){
+    end = (uint)b->data + BSIZE;
+    for(a = (uint)b->data; a < end; a += n){
+      n = PGROUNDUP(a+1) - a;
+      if(n > end - a)
+        n = end - a;
+      p->addr = V2P(a);
+      p->len = n;
+      p->flags = 0;
+      p++;
+    }
+  }
+  p[-1].flags = PRD_EOT;
 }
 
-// Start the request for b.  Caller must hold idelock.
+// Ask disk dev to move IDEMULT sectors per interrupt.
+// Returns IDEMULT, or 0 if it will not.
+static int
+idesetmult(int dev)
+{
+  outb(0x1f6, 0xe0 | (dev<<4));
+  outb(0x1f2, IDEMULT);
+  outb(0x1f7, IDE_CMD_SETMUL);
+  if(idewait(1) < 0)
+    return 0;
+  return IDEMULT;
+}
+
+// Return the size of disk dev in blocks, from the LBA28
+// sector count IDENTIFY DEVICE reports, or 0 if it does not
+// answer.
+static uint
+idesize(int dev)
+{
+  ushort id[SECTOR_SIZE/2];
+
+  if(dev != 0 && !havedisk1)
+    return 0;
+  outb(0x1f6, 0xe0 | (dev<<4));
+  outb(0x1f7, IDE_CMD_IDENT);
+  if(idewait(1) < 0)
+    return 0;
+  insl(0x1f0, id, SECTOR_SIZE/4);
+  return (id[60] | (id[61] << 16)) / (BSIZE/SECTOR_SIZE);
+}
+
+// Number of blocks in the swap area on disk SWAPDEV: up to
+// SWAPSIZE, which the Makefile leaves after the kernel, but
+// no more than the disk really has.
+int
+ideswapsize(void)
+{
+  return swapsize;
+}
+
+// Move up to nsect sectors of the active run between memory
+// and the data port, scattering reads and gathering writes
+// across its buffers.  Caller must hold idelock.
+static void
+idepio(int nsect, int write)
+{
+  uchar *p;
+
+  for(; nsect > 0 && idexfer; nsect--){
+    p = idexfer->data + idesect*SECTOR_SIZE;
+    if(write)
+      outsl(0x1f0, p, SECTOR_SIZE/4);
+    else
+      insl(0x1f0, p, SECTOR_SIZE/4);
+    if(++idesect == BSIZE/SECTOR_SIZE){
+      idexfer = idexfer->qnext;
+      idesect = 0;
+    }
+  }
+}
+
+// Start the request for b, along with the queued requests
+// for the blocks after it in the same direction.
+// Caller must hold idelock.
 static void
 idestart(struct buf *b)
 {
+  struct buf *last;
+  int n, write;
+
   if(b == 0)
     panic("idestart");
-  if(b->blockno >= FSSIZE)
+  int sector_per_block =  BSIZE/SECTOR_SIZE;
+
+  if (sector_per_block > IDEMAXSECT) panic("idestart");
+
+  b->tstart = rdtsc();
+  write = (b->flags & B_DIRTY) != 0;
+  last = b;
+  for(n = 1; (n+1)*sector_per_block <= IDEMAXSECT && sweep != 0; n++){
+    if(sweep->dev != b->dev || sweep->blockno != last->blockno + 1 ||
+       ((sweep->flags & B_DIRTY) != 0) != write)
+      break;
+    last->qnext = sweep;
+    last = sweep;
+    sweep = qmerge(sweep->qleft, sweep->qright);
+    last->tstart = b->tstart;
+  }
+  last->qnext = 0;
+  if(last->blockno >= (b->dev == SWAPDEV ? SWAPSTART+swapsize : FSSIZE))
     panic("incorrect blockno");
+  idecmd();
+}
+
+// Issue the disk command for the run at idecur.
+// Caller must hold idelock.
+static void
+idecmd(void)
+{
+  struct buf *b, *last;
+  int n, write, mult;
+  uint t0;
+
+  t0 = rdtsc();
+  b = idecur;
+  n = 1;
+  for(last = b; last->qnext != 0; last = last->qnext)
+    n++;
   int sector_per_block =  BSIZE/SECTOR_SIZE;
   int sector = b->blockno * sector_per_block;
-  int read_cmd = (sector_per_block == 1) ? IDE_CMD_READ :  IDE_CMD_RDMUL;
-  int write_cmd = (sector_per_block == 1) ? IDE_CMD_WRITE : IDE_CMD_WRMUL;
+  write = (b->flags & B_DIRTY) != 0;
+  mult = idemult[b->dev&1];
+  idexfer = b;
+  idesect = 0;
+  idestat.ncmd++;
 
-  if (sector_per_block > 7) panic("idestart");
+  if(idedma){
+    prdfill();
+    outl(bmiba+BM_PRDT, V2P(prdt));
+    outb(bmiba+BM_CMD, write ? 0 : BM_READ);
+    outb(bmiba+BM_STATUS, BM_INTR|BM_ERR);
+  }
 
   idewait(0);
   outb(0x3f6, 0);  // generate interrupt
-  outb(0x1f2, sector_per_block);  // number of sectors
+  outb(0x1f2, n*sector_per_block);  // number of sectors
   outb(0x1f3, sector & 0xff);
   outb(0x1f4, (sector >> 8) & 0xff);
   outb(0x1f5, (sector >> 16) & 0xff);
   outb(0x1f6, 0xe0 | ((b->dev&1)<<4) | ((sector>>24)&0x0f));
-  if(b->flags & B_DIRTY){
-    outb(0x1f7, write_cmd);
-    outsl(0x1f0, b->data, BSIZE/4);
+  if(idedma){
+    outb(0x1f7, write ? IDE_CMD_WRDMA : IDE_CMD_RDDMA);
+    outb(bmiba+BM_CMD, (write ? 0 : BM_READ) | BM_START);
+  } else if(write){
+    outb(0x1f7, mult ? IDE_CMD_WRMUL : IDE_CMD_WRITE);
+    idepio(mult ? mult : 1, 1);
   } else {
-    outb(0x1f7, read_cmd);
+    outb(0x1f7, mult ? IDE_CMD_RDMUL : IDE_CMD_READ);
+  }
+  idestat.ncycles += rdtsc() - t0;
+}
+
+// Does a come before b on the disk?
+static int
+qbefore(struct buf *a, struct buf *b)
+{
+  if(a->dev != b->dev)
+    return a->dev < b->dev;
+  return a->blockno < b->blockno;
+}
+
+static int
+qrank(struct buf *b)
+{
+  return b ? b->qrank : 0;
+}
+
+// Merge two leftist heaps.  The recursion follows right
+// spines, which are O(log n) long.
+static struct buf*
+qmerge(struct buf *a, struct buf *b)
+{
+  struct buf *t;
+
+  if(a == 0)
+    return b;
+  if(b == 0)
+    return a;
+  if(qbefore(b, a)){
+    t = a;
+    a = b;
+    b = t;
+  }
+  a->qright = qmerge(a->qright, b);
+  if(qrank(a->qleft) < qrank(a->qright)){
+    t = a->qleft;
+    a->qleft = a->qright;
+    a->qright = t;
   }
+  a->qrank = qrank(a->qright) + 1;
+  return a;
+}
+
+// Queue b behind idecur, in this sweep if it lies ahead.
+static void
+ideinsert(struct buf *b)
+{
+  b->qleft = b->qright = 0;
+  b->qrank = 1;
+  if(qbefore(idecur, b) && nlate < SWEEPLATE){
+    sweep = qmerge(sweep, b);
+    nlate++;
+  } else
+    nextsweep = qmerge(nextsweep, b);
+}
+
+// Take the next request in elevator order, or return 0.
+static struct buf*
+idenext(void)
+{
+  struct buf *b;
+
+  if(sweep == 0){
+    sweep = nextsweep;
+    nextsweep = 0;
+    nlate = 0;
+  }
+  if((b = sweep) != 0)
+    sweep = qmerge(b->qleft, b->qright);
+  return b;
 }
 
 // Interrupt handler.
 void
 ideintr(void)
 {
-  struct buf *b;
+  struct buf *b, *done;
+  int write, mult, st;
+  uint t, t0;
 
   // First queued buffer is the active request.
   acquire(&idelock);
 
-  if((b = idequeue) == 0){
+  if((b = idecur) == 0){
     release(&idelock);
     return;
   }
-  idequeue = b->qnext;
 
-  // Read data if needed.
-  if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
-    insl(0x1f0, b->data, BSIZE/4);
+  t0 = rdtsc();
+  write = (b->flags & B_DIRTY) != 0;
+  mult = idemult[b->dev&1];
+  // A DMA command interrupts once, when the whole run is in
+  // place.  With PIO, read the sectors the disk has ready; a
+  // write's interrupt says the last ones sent are on disk.
+  // On an error the disk gives up on the rest of the run.
+  if(idedma){
+    st = inb(bmiba+BM_STATUS);
+    if((st & BM_INTR) == 0){
+      release(&idelock);
+      return;
+    }
+    outb(bmiba+BM_CMD, 0);
+    outb(bmiba+BM_STATUS, BM_INTR|BM_ERR);
+    if((st & BM_ERR) || idewait(1) < 0){
+      cprintf("ide: dma failed, using pio\n");
+      idedma = 0;
+      idecmd();
+      release(&idelock);
+      return;
+    }
+    idexfer = 0;
+  } else if(idewait(1) < 0)
+    idexfer = 0;
+  else if(!write)
+    idepio(mult ? mult : 1, 0);
 
-  // Wake process waiting for this buf.
-  b->flags |= B_VALID;
-  b->flags &= ~B_DIRTY;
-  wakeup(b);
+  // Wake processes waiting for the bufs now done.
+  t = rdtsc();
+  done = 0;
+  while((b = idecur) != idexfer){
+    idecur = b->qnext;
+    idestat.depth--;
+    idestat.nsect += BSIZE/SECTOR_SIZE;
+    idestat.avgservice += (int)(t - b->tstart - idestat.avgservice) / 8;
+    idestat.avgwait += (int)(t - b->tsubmit - idestat.avgwait) / 8;
+    b->flags |= B_VALID;
+    b->flags &= ~B_DIRTY;
+    wakeup(b);
+    if(b->flags & B_ASYNC){
+      b->flags &= ~B_ASYNC;
+      b->qnext = done;
+      done = b;
+    }
+  }
+  if(nwaitany)
+    wakeup(&nwaitany);
 
-  // Start disk on next buf in queue.
-  if(idequeue != 0)
-    idestart(idequeue);
+  // Send the run's next sectors, or start disk on next buf in queue.
+  if(idecur != 0 && write)
+    idepio(mult ? mult : 1, 1);
+  idestat.ncycles += rdtsc() - t0;
+  if(idecur == 0 && (idecur = idenext()) != 0)
+    idestart(idecur);
 
   release(&idelock);
+
+  // No one waits for a read-ahead; release its buffer.
+  while((b = done) != 0){
+    done = b->qnext;
+    bdone(b);
+  }
 }
 
 //PAGEBREAK!
-// Sync buf with disk.
+// Queue b for the disk and return without waiting.
 // If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
 // Else if B_VALID is not set, read buf from disk, set B_VALID.
+// b must stay locked until idewaitany() or idewaitall() says it
+// is done, unless B_ASYNC is set: then ideintr() passes b to
+// bdone() instead.
 void
-iderw(struct buf *b)
+idesubmit(struct buf *b)
 {
-  struct buf **pp;
-
   if(!holdingsleep(&b->lock))
     panic("iderw: buf not locked");
   if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
@@ -148,21 +546,80 @@ iderw(struct buf *b)
 
   acquire(&idelock);  //DOC:acquire-lock
 
-  // Append b to idequeue.
-  b->qnext = 0;
-  for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
-    ;
-  *pp = b;
+  b->tsubmit = rdtsc();
+  idestat.nreq++;
+  if(b->flags & B_DIRTY)
+    idestat.nwrite++;
+  else
+    idestat.nread++;
+  idestat.sumdepth += idestat.depth;
+  if(++idestat.depth > idestat.maxdepth)
+    idestat.maxdepth = idestat.depth;
 
   // Start disk if necessary.
-  if(idequeue == b)
+  if(idecur == 0){
+    idecur = b;
     idestart(b);
+  } else
+    ideinsert(b);
+
+  release(&idelock);
+}
+
+static int
+isdone(struct buf *b)
+{
+  return (b->flags & (B_VALID|B_DIRTY)) == B_VALID;
+}
+
+// Wait until the disk is done with one of the n submitted
+// buffers in bs, and return its index.
+int
+idewaitany(struct buf **bs, int n)
+{
+  int i;
 
-  // Wait for request to finish.
-  while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
-    sleep(b, &idelock);
+  acquire(&idelock);
+  for(;;){
+    for(i = 0; i < n; i++){
+      if(isdone(bs[i])){
+        release(&idelock);
+        return i;
+      }
+    }
+    nwaitany++;
+    sleep(&nwaitany, &idelock);
+    nwaitany--;
   }
+}
 
+// Wait until the disk is done with all n submitted buffers in bs.
+void
+idewaitall(struct buf **bs, int n)
+{
+  int i;
+
+  acquire(&idelock);
+  for(i = 0; i < n; i++)
+    while(!isdone(bs[i]))
+      sleep(bs[i], &idelock);
+  release(&idelock);
+}
 
+// Sync buf with disk: submit it and wait.
+void
+iderw(struct buf *b)
+{
+  idesubmit(b);
+  idewaitall(&b, 1);
+}
+
+// Fill in the disk queue statistics.
+void
+idestats(struct kdiskstat *st)
+{
+  acquire(&idelock);
+  *st = idestat;
+  st->dma = idedma;
   release(&idelock);
 }
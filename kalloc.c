@@ -1,6 +1,12 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
-// and pipe buffers. Allocates 4096-byte pages.
+// and pipe buffers.
+//
+// A binary buddy allocator: kallocpages(order) hands out
+// 2^order physically contiguous, naturally aligned pages,
+// and kfreepages() merges a freed block with its buddy
+// whenever the buddy is free too.  kalloc() and kfree()
+// are the order-0 (one 4096-byte page) case.
 
 #include "types.h"
 #include "defs.h"
@@ -8,21 +14,81 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "spinlock.h"
+#include "kstat.h"
 
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
                    // defined by the kernel linker script in kernel.ld
 
+// Freed pages are filled with junk to catch dangling refs.
+// Build with KPOISON=0 (see Makefile) to skip that extra
+// page write on every kfree().
+#ifndef KPOISON
+#define KPOISON 1
+#endif
+
+#define NZPOOL   64  // pre-zeroed pages kept ready by the idle loop
+#define NZREFILL  8  // pages zeroed per idle pass
+
+#define NPAGES  (DIRECTMAX/PGSIZE)
+#define PFN(v)  (V2P(v)/PGSIZE)
+
+// Lives in the first bytes of each free block.
 struct run {
   struct run *next;
+  struct run *prev;
 };
 
+// free[k] is a circular list of the free blocks of 2^k pages.
+// order[pfn] is k+1 if page pfn starts a free block of order k,
+// and 0 otherwise, so kfreepages() can check a buddy in O(1).
+//
+// zerolist holds order-0 pages that are all zeroes except for
+// the run links, which kzalloc() clears when it hands one out.
+// The buddy lists treat them as allocated.
+//
+// ref[pfn] counts the users of an allocated block (it is kept
+// for the block's first page).  Allocation sets it to 1,
+// kincref() adds a user, such as a second page table mapping
+// the page, and kfreepages() frees the block only when the
+// last user lets go.
 struct {
   struct spinlock lock;
   int use_lock;
-  struct run *freelist;
+  struct run free[MAXORDER+1];
+  uint nfree[MAXORDER+1];
+  uchar order[NPAGES];
+  ushort ref[NPAGES];
+  uint npages;
+  struct run *zerolist;
+  int nzero;
 } kmem;
 
+static void freeblock(char *v, int order);
+
+static void
+listinit(struct run *head)
+{
+  head->next = head;
+  head->prev = head;
+}
+
+static void
+listadd(struct run *head, struct run *r)
+{
+  r->next = head->next;
+  r->prev = head;
+  head->next->prev = r;
+  head->next = r;
+}
+
+static void
+listdel(struct run *r)
+{
+  r->prev->next = r->next;
+  r->next->prev = r->prev;
+}
+
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
 // the pages mapped by entrypgdir on free list.
@@ -31,8 +97,12 @@ struct {
 void
 kinit1(void *vstart, void *vend)
 {
+  int k;
+
   initlock(&kmem.lock, "kmem");
   kmem.use_lock = 0;
+  for(k = 0; k <= MAXORDER; k++)
+    listinit(&kmem.free[k]);
   freerange(vstart, vend);
 }
 
@@ -48,37 +118,145 @@ freerange(void *vstart, void *vend)
 {
   char *p;
   p = (char*)PGROUNDUP((uint)vstart);
-  for(; p + PGSIZE <= (char*)vend; p += PGSIZE)
-    kfree(p);
+  // Never-used pages cannot hold dangling refs, so don't poison them.
+  for(; p + PGSIZE <= (char*)vend; p += PGSIZE){
+    kmem.npages++;
+    freeblock(p, 0);
+  }
 }
+
 //PAGEBREAK: 21
+// Drop a reference to the 2^order pages pointed at by v,
+// which normally should have been returned by a call to
+// kallocpages(order), and free them if it was the last one.
+// (The exception is when initializing the allocator;
+// see kinit above.)
+void
+kfreepages(char *v, int order)
+{
+  uint pfn;
+
+  if(order < 0 || order > MAXORDER)
+    panic("kfreepages: order");
+  if(V2P(v) % (PGSIZE << order) || v < end ||
+     V2P(v) + (PGSIZE << order) > phystop)
+    panic("kfree");
+  pfn = PFN(v);
+
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  if(kmem.ref[pfn] == 0)
+    panic("kfree: not allocated");
+  if(--kmem.ref[pfn] > 0){
+    if(kmem.use_lock)
+      release(&kmem.lock);
+    return;
+  }
+#if KPOISON
+  if(kmem.use_lock)
+    release(&kmem.lock);
+
+  // Fill with junk to catch dangling refs.
+  memset(v, 1, PGSIZE << order);
+
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+#endif
+  freeblock(v, order);
+  if(kmem.use_lock)
+    release(&kmem.lock);
+}
+
 // Free the page of physical memory pointed at by v,
 // which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// call to kalloc().
 void
 kfree(char *v)
+{
+  kfreepages(v, 0);
+}
+
+// Put the block v of 2^order pages on the free lists,
+// merging it with its buddy for as long as the buddy is
+// also free.  Caller holds kmem.lock if use_lock is set.
+static void
+freeblock(char *v, int order)
+{
+  uint pfn, bpfn;
+
+  pfn = PFN(v);
+  while(order < MAXORDER){
+    bpfn = pfn ^ (1 << order);
+    if(bpfn >= NPAGES || kmem.order[bpfn] != order+1)
+      break;
+    // Buddy is free: take it off its list and merge.
+    kmem.order[bpfn] = 0;
+    listdel((struct run*)P2V(bpfn*PGSIZE));
+    kmem.nfree[order]--;
+    pfn &= ~(1 << order);
+    order++;
+  }
+  kmem.order[pfn] = order+1;
+  listadd(&kmem.free[order], (struct run*)P2V(pfn*PGSIZE));
+  kmem.nfree[order]++;
+}
+
+// Take a block of 2^order pages off the free lists, splitting
+// a larger block if there is no block of exactly that size.
+// Caller holds kmem.lock if use_lock is set.
+static char*
+allocblock(int order)
 {
   struct run *r;
+  uint pfn;
+  int k;
 
-  if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
-    panic("kfree");
+  for(k = order; k <= MAXORDER; k++)
+    if(kmem.free[k].next != &kmem.free[k])
+      break;
+  if(k > MAXORDER)
+    return 0;
 
-  // Fill with junk to catch dangling refs.
-  memset(v, 1, PGSIZE);
+  r = kmem.free[k].next;
+  listdel(r);
+  kmem.nfree[k]--;
+  pfn = PFN(r);
+  kmem.order[pfn] = 0;
+  kmem.ref[pfn] = 1;
+
+  // Return the unused upper halves to the lower-order lists.
+  while(k > order){
+    k--;
+    kmem.order[pfn + (1 << k)] = k+1;
+    listadd(&kmem.free[k], (struct run*)P2V((pfn + (1 << k))*PGSIZE));
+    kmem.nfree[k]++;
+  }
+  return (char*)r;
+}
 
+// Allocate 2^order physically contiguous pages, aligned to
+// their size.  Returns a pointer that the kernel can use.
+// Returns 0 if the memory cannot be allocated.
+// The page contents are undefined.
+char*
+kallocpages(int order)
+{
+  char *v;
+
+  if(order < 0 || order > MAXORDER)
+    return 0;
   if(kmem.use_lock)
     acquire(&kmem.lock);
-  r = (struct run*)v;
-  r->next = kmem.freelist;
-  kmem.freelist = r;
+  v = allocblock(order);
   if(kmem.use_lock)
     release(&kmem.lock);
+  return v;
 }
 
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
+// The page contents are undefined.
 char*
 kalloc(void)
 {
@@ -86,11 +264,132 @@ kalloc(void)
 
   if(kmem.use_lock)
     acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
+  // Fast path: an order-0 block needs no splitting.
+  if((r = kmem.free[0].next) != &kmem.free[0]){
+    listdel(r);
+    kmem.nfree[0]--;
+    kmem.order[PFN(r)] = 0;
+    kmem.ref[PFN(r)] = 1;
+  } else if((r = (struct run*)allocblock(0)) == 0 &&
+            (r = kmem.zerolist) != 0){
+    kmem.zerolist = r->next;
+    kmem.nzero--;
+  }
+  if(kmem.use_lock)
+    release(&kmem.lock);
+  return (char*)r;
+}
+
+// Allocate one zero-filled page, for user memory and
+// page tables.  Takes a page zeroed by the idle loop
+// if there is one, so the caller doesn't pay for memset.
+char*
+kzalloc(void)
+{
+  struct run *r;
+
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  if((r = kmem.zerolist) != 0){
+    kmem.zerolist = r->next;
+    kmem.nzero--;
+  }
   if(kmem.use_lock)
     release(&kmem.lock);
+
+  if(r){
+    memset(r, 0, sizeof(*r));
+    return (char*)r;
+  }
+  if((r = (struct run*)kalloc()) != 0)
+    memset(r, 0, PGSIZE);
   return (char*)r;
 }
 
+// Add a reference to the allocated page v.
+void
+kincref(char *v)
+{
+  if((uint)v % PGSIZE || v < end || V2P(v) >= phystop)
+    panic("kincref");
+  acquire(&kmem.lock);
+  if(kmem.ref[PFN(v)] == 0)
+    panic("kincref: not allocated");
+  kmem.ref[PFN(v)]++;
+  release(&kmem.lock);
+}
+
+// Drop a reference to the allocated page v, unless it is
+// the last one.  Returns 1 if it dropped one, or 0 if the
+// caller holds the only reference and should clean up and
+// kfree() v itself.
+int
+kunshare(char *v)
+{
+  int shared;
+
+  acquire(&kmem.lock);
+  if((shared = kmem.ref[PFN(v)] > 1))
+    kmem.ref[PFN(v)]--;
+  release(&kmem.lock);
+  return shared;
+}
+
+// Return the number of references to the allocated page v.
+int
+krefcount(char *v)
+{
+  return kmem.ref[PFN(v)];
+}
+
+// Move a few pages from the free lists to the zeroed pool.
+// Called by scheduler() when it found nothing to run, so the
+// zeroing happens on otherwise idle cycles.
+void
+kzrefill(void)
+{
+  struct run *r;
+  int i;
+
+  // Other CPUs idle in scheduler() before kinit2() finishes.
+  if(!kmem.use_lock)
+    return;
+
+  for(i = 0; i < NZREFILL; i++){
+    acquire(&kmem.lock);
+    if(kmem.nzero >= NZPOOL || (r = (struct run*)allocblock(0)) == 0){
+      release(&kmem.lock);
+      return;
+    }
+    release(&kmem.lock);
+
+    memset(r, 0, PGSIZE);
+
+    acquire(&kmem.lock);
+    r->next = kmem.zerolist;
+    kmem.zerolist = r;
+    kmem.nzero++;
+    release(&kmem.lock);
+  }
+}
+
+// Report free block counts, so fragmentation is visible
+// from user space: lots of free pages but few high-order
+// blocks means kallocpages() of large orders will fail.
+void
+kmemstat(struct kmemstat *st)
+{
+  int k;
+
+  acquire(&kmem.lock);
+  st->npages = kmem.npages;
+  st->nzeropages = kmem.nzero;
+  st->nfreepages = kmem.nzero;
+  for(k = 0; k <= MAXORDER; k++){
+    st->nfree[k] = kmem.nfree[k];
+    st->nfreepages += kmem.nfree[k] << k;
+  }
+  release(&kmem.lock);
+  highstat(st);
+  swapstat(st);
+}
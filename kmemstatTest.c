@@ -0,0 +1,43 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "kstat.h"
+
+void
+printstat(char *when)
+{
+  struct kmemstat st;
+  int k;
+
+  if(kmemstat(&st) < 0){
+    printf(1, "kmemstat failed\n");
+    exit();
+  }
+  printf(1, "%s: %d of %d pages free (%d zeroed), %d of %d high pages free\n",
+         when, st.nfreepages, st.npages, st.nzeropages,
+         st.nfreehigh, st.nhighpages);
+  printf(1, "  free blocks by order:");
+  for(k = 0; k <= MAXORDER; k++)
+    printf(1, " %d", st.nfree[k]);
+  printf(1, "\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n;
+
+  n = 1024*1024;
+  if(argc > 1)
+    n = atoi(argv[1]);
+
+  printstat("before");
+  if(sbrk(n) == (char*)-1){
+    printf(1, "sbrk(%d) failed\n", n);
+    exit();
+  }
+  printstat("after sbrk");
+  sbrk(-n);
+  printstat("after release");
+  exit();
+}
@@ -0,0 +1,52 @@
+// Kernel statistics.
+// Both the kernel and user programs use this header file.
+
+#define MAXORDER 10  // largest kallocpages() block is 2^MAXORDER pages
+
+// Physical page allocator, filled in by kmemstat().
+struct kmemstat {
+  uint npages;               // pages managed by the allocator
+  uint nfreepages;           // free pages, including the zeroed pool
+  uint nzeropages;           // pages in the pre-zeroed pool
+  uint nfree[MAXORDER+1];    // free blocks of each order
+  uint nhighpages;           // pages above the direct map, for user memory
+  uint nfreehigh;            // free pages among them
+  uint nswapslots;           // pages the swap area holds
+  uint nfreeswap;            // free slots among them
+  uint nswapout;             // pages written to swap
+  uint nswapin;              // pages read back from swap
+};
+
+// Buffer cache, filled in by kbufstat().
+struct kbufstat {
+  uint nbuf;                 // buffers in the cache
+  uint nhit;                 // lookups that found the block cached
+  uint nmiss;                // lookups that had to take a buffer
+  uint nevict;               // misses that dropped another cached block
+  uint nread;                // blocks read from disk
+  uint nwrite;               // blocks written to disk
+  uint nreadahead;           // blocks read before anyone asked for them
+};
+
+// IDE disk queue, filled in by kdiskstat().
+struct kdiskstat {
+  uint nreq;                 // requests submitted
+  uint nread;                // reads among them
+  uint nwrite;               // writes among them
+  uint depth;                // requests now queued, including the active one
+  uint maxdepth;             // deepest the queue has been
+  uint sumdepth;             // queue depth each request found, summed
+  uint avgwait;              // rdtsc() cycles from submit to done, averaged
+  uint avgservice;           // cycles the disk spent on it, averaged
+  uint ncmd;                 // disk commands, each covering a run of requests
+  uint nsect;                // sectors moved to or from the disk
+  uint ncycles;              // cycles the driver spent starting commands and moving data
+  uint dma;                  // 1 if the disk moves data by bus-master DMA, 0 for PIO
+};
+
+// Scheduler context switches summed over all CPUs,
+// filled in by kswitchstat().
+struct kswitchstat {
+  uint nswitch;              // processes run
+  uint ncr3;                 // page table switches, each a TLB flush
+};
@@ -27,7 +27,7 @@
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// A commit waits for the log writes before writing the header.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
@@ -65,19 +65,27 @@ initlog(int dev)
   recover_from_log();
 }
 
-// Copy committed blocks from log to their home location
+// Copy committed blocks from log to their home location.
+// The writes all go on the disk queue at once, and each
+// buffer is released as soon as its write is done.
 static void
 install_trans(void)
 {
-  int tail;
+  struct buf *dbufs[LOGSIZE];
+  int tail, n;
 
   for (tail = 0; tail < log.lh.n; tail++) {
     struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
     struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
     memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
+    bwritestart(dbuf);  // write dst to disk
     brelse(lbuf);
-    brelse(dbuf);
+    dbufs[tail] = dbuf;
+  }
+  for (n = log.lh.n; n > 0; n--) {
+    tail = bwaitany(dbufs, n);
+    brelse(dbufs[tail]);
+    dbufs[tail] = dbufs[n-1];
   }
 }
 
@@ -173,20 +181,26 @@ end_op(void)
   }
 }
 
-// Copy modified blocks from cache to log.
+// Copy modified blocks from cache to log, keeping all the
+// writes on the disk queue together.  The header must not
+// be written until they are all done.
 static void
 write_log(void)
 {
+  struct buf *tos[LOGSIZE];
   int tail;
 
   for (tail = 0; tail < log.lh.n; tail++) {
     struct buf *to = bread(log.dev, log.start+tail+1); // log block
     struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
     memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
+    bwritestart(to);  // write the log
     brelse(from);
-    brelse(to);
+    tos[tail] = to;
   }
+  bwaitall(tos, log.lh.n);
+  for (tail = 0; tail < log.lh.n; tail++)
+    brelse(tos[tail]);
 }
 
 static void
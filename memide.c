@@ -12,6 +12,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "kstat.h"
 
 extern uchar _binary_fs_img_start[], _binary_fs_img_size[];
 
@@ -25,6 +26,13 @@ ideinit(void)
   disksize = (uint)_binary_fs_img_size/BSIZE;
 }
 
+// The memory disk has no swap area.
+int
+ideswapsize(void)
+{
+  return 0;
+}
+
 // Interrupt handler.
 void
 ideintr(void)
@@ -58,3 +66,33 @@ iderw(struct buf *b)
     memmove(b->data, p, BSIZE);
   b->flags |= B_VALID;
 }
+
+// The memory disk finishes each request at once.
+void
+idesubmit(struct buf *b)
+{
+  int async;
+
+  async = b->flags & B_ASYNC;
+  b->flags &= ~B_ASYNC;
+  iderw(b);
+  if(async)
+    bdone(b);
+}
+
+int
+idewaitany(struct buf **bs, int n)
+{
+  return 0;
+}
+
+void
+idewaitall(struct buf **bs, int n)
+{
+}
+
+void
+idestats(struct kdiskstat *st)
+{
+  memset(st, 0, sizeof(*st));
+}
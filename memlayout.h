@@ -1,12 +1,18 @@
 // Memory layout
 
 #define EXTMEM  0x100000            // Start of extended memory
-#define PHYSTOP 0xE000000           // Top physical memory
+#define PHYSTOP 0xE000000           // Top physical memory if the BIOS has no map
+#define DIRECTMAX 0x38000000        // Most physical memory mapped at KERNBASE
 #define DEVSPACE 0xFE000000         // Other devices are at high addresses
+#define E820MAP 0x8000              // BIOS memory map, saved by bootasm.S
 
 // Key addresses for address space layout (see kmap in vm.c for layout)
 #define KERNBASE 0x80000000         // First kernel virtual address
 #define KERNLINK (KERNBASE+EXTMEM)  // Address where kernel is linked
+#define UPROC    (KERNBASE-0x1000)  // this process's struct vproc (vdata.h)
+#define MMAPTOP  UPROC              // mmap regions are placed below here
+#define TMPMAPBASE (KERNBASE+DIRECTMAX) // tmpmap() window for high memory
+#define VDATA    (TMPMAPBASE+0x3FF000) // struct vdata, in the tmpmap() page table
 
 #define V2P(a) (((uint) (a)) - KERNBASE)
 #define P2V(a) ((void *)(((char *) (a)) + KERNBASE))
@@ -0,0 +1,358 @@
+// Memory-mapped files.
+//
+// mmap() only records a region in the process's vma table;
+// pages are mapped on demand by vmafault(), called from trap()
+// on a page fault.  File pages come from the page cache
+// (pcache.c) and are mapped directly, so reading a mapped file
+// copies nothing.  MAP_PRIVATE regions map the cached page
+// read-only and copy it on the first write.  Dirty pages of
+// MAP_SHARED regions are written back to the file through the
+// log when the region is unmapped.
+//
+// Shared memory segments (shm.c) are regions too, with pages
+// from the segment instead of the page cache.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "fs.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "fcntl.h"
+#include "stat.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+// Return the region of p's address space that holds va, or 0.
+struct vma*
+findvma(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start && v->start <= va && va < v->end)
+      return v;
+  return 0;
+}
+
+// Lowest address used by p's regions.  The heap must stay below it.
+uint
+vmabase(struct proc *p)
+{
+  struct vma *v;
+  uint base;
+
+  base = MMAPTOP;
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start && v->start < base)
+      base = v->start;
+  return base;
+}
+
+// Pick an address for a len-byte region: the highest
+// free range below MMAPTOP.  Returns 0 if none is left
+// above the heap.
+static uint
+vmaplace(struct proc *p, uint len)
+{
+  struct vma *v;
+  uint a;
+
+  if(len > MMAPTOP)
+    return 0;
+  a = MMAPTOP - len;
+again:
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->start && a < v->end && v->start < a + len){
+      if(v->start < len)
+        return 0;
+      a = v->start - len;
+      goto again;
+    }
+  }
+  if(a < PGROUNDUP(p->sz))
+    return 0;
+  return a;
+}
+
+// Set up an empty len-byte region in p, for the caller to
+// fill in.  len must be a multiple of PGSIZE.  The region
+// table is per process, so threads sharing p's page table
+// (see clone()) cannot have regions.
+struct vma*
+vmaalloc(struct proc *p, uint len)
+{
+  struct vma *v;
+  uint a;
+
+  if(sharedpgdir(p))
+    return 0;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start == 0)
+      break;
+  if(v == &p->vma[NVMA])
+    return 0;
+  if((a = vmaplace(p, len)) == 0)
+    return 0;
+  memset(v, 0, sizeof(*v));
+  v->start = a;
+  v->end = a + len;
+  return v;
+}
+
+// Map len bytes of f, starting at file offset off, into the
+// current process.  Returns the address of the region, or -1.
+int
+mmap(struct file *f, uint len, int prot, int flags, uint off)
+{
+  struct vma *v;
+
+  if(f->type != FD_INODE || !f->readable)
+    return -1;
+  if(flags != MAP_SHARED && flags != MAP_PRIVATE)
+    return -1;
+  if((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable)
+    return -1;
+  if(len == 0 || off % PGSIZE != 0)
+    return -1;
+  len = PGROUNDUP(len);
+
+  ilock(f->ip);
+  if(f->ip->type != T_FILE){
+    iunlock(f->ip);
+    return -1;
+  }
+  iunlock(f->ip);
+
+  if((v = vmaalloc(myproc(), len)) == 0)
+    return -1;
+  v->prot = prot;
+  v->flags = flags;
+  v->off = off;
+  v->f = filedup(f);
+  return v->start;
+}
+
+// Write a dirty page of a MAP_SHARED region back to the file,
+// a few blocks per transaction like filewrite().  The file
+// does not grow: bytes past its end are dropped.
+static void
+writeback(struct inode *ip, char *page, uint off)
+{
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  uint i, n;
+
+  for(i = 0; i < PGSIZE; i += max){
+    begin_op();
+    ilock(ip);
+    if(off + i < ip->size){
+      n = min(min(max, PGSIZE - i), ip->size - (off + i));
+      writei(ip, page + i, off + i, n);
+    }
+    iunlock(ip);
+    end_op();
+  }
+}
+
+// Remove region v from p's address space, writing back
+// dirty shared pages and dropping the page references.
+void
+vmaunmap(struct proc *p, struct vma *v)
+{
+  pte_t *pte;
+  char *page;
+  uint a;
+
+  for(a = v->start; a < v->end; a += PGSIZE){
+    if((pte = walkpgdir(p->pgdir, (char*)a, 0)) == 0)
+      continue;
+    if((*pte & PTE_P) == 0)
+      continue;
+    page = P2V(PTE_ADDR(*pte));
+    if(v->f && (v->flags & MAP_SHARED) && (*pte & PTE_D))
+      writeback(v->f->ip, page, v->off + (a - v->start));
+    *pte = 0;
+    kfree(page);
+  }
+  if(p == myproc())
+    lcr3(V2P(p->pgdir));  // flush the stale TLB entries
+  if(v->f)
+    fileclose(v->f);
+  if(v->shm)
+    shmput(v->shm);
+  memset(v, 0, sizeof(*v));
+}
+
+// Unmap the region that starts at addr.  Regions can only be
+// unmapped whole, so len must be the length they were mapped with.
+int
+munmap(uint addr, uint len)
+{
+  struct proc *curproc = myproc();
+  struct vma *v;
+
+  if((v = findvma(curproc, addr)) == 0 || v->f == 0)
+    return -1;
+  if(v->start != addr || v->end != addr + PGROUNDUP(len))
+    return -1;
+  vmaunmap(curproc, v);
+  return 0;
+}
+
+// Unmap all of p's regions, on exit() and exec().
+void
+vmaunmapall(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start)
+      vmaunmap(p, v);
+}
+
+// Give child np copies of p's regions, for fork().  Pages
+// already mapped are shared, except the private copies of
+// MAP_PRIVATE regions, which np gets its own copies of.
+int
+vmadup(struct proc *np, struct proc *p)
+{
+  struct vma *v, *nv;
+  pte_t *pte;
+  char *page, *mem;
+  uint a;
+
+  for(v = p->vma, nv = np->vma; v < &p->vma[NVMA]; v++, nv++){
+    if(v->start == 0)
+      continue;
+    *nv = *v;
+    if(v->f)
+      filedup(v->f);
+    if(v->shm)
+      shmdup(v->shm);
+    for(a = v->start; a < v->end; a += PGSIZE){
+      if((pte = walkpgdir(p->pgdir, (char*)a, 0)) == 0)
+        continue;
+      if((*pte & PTE_P) == 0)
+        continue;
+      page = P2V(PTE_ADDR(*pte));
+      if((v->flags & MAP_PRIVATE) && (*pte & PTE_W)){
+        if((mem = kalloc()) == 0)
+          return -1;
+        memmove(mem, page, PGSIZE);
+        page = mem;
+      } else
+        kincref(page);
+      if(mappages(np->pgdir, (char*)a, PGSIZE, V2P(page),
+                  PTE_FLAGS(*pte) & ~(PTE_A|PTE_D)) < 0){
+        kfree(page);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+// Handle a page fault at va in p's address space.
+// Returns 0 if the access can be retried, or -1 if va is
+// not in a region or the access is not allowed.
+int
+vmafault(struct proc *p, uint va, int write)
+{
+  struct vma *v;
+  pte_t *pte;
+  char *page, *mem;
+  int perm;
+
+  if((v = findvma(p, va)) == 0)
+    return -1;
+  if(write && (v->prot & PROT_WRITE) == 0)
+    return -1;
+  va = PGROUNDDOWN(va);
+
+  pte = walkpgdir(p->pgdir, (char*)va, 0);
+  if(pte && (*pte & PTE_P)){
+    if(!write || (*pte & PTE_W))
+      return 0;
+    // First write to a private region's page: copy it.
+    if((v->flags & MAP_PRIVATE) == 0)
+      return -1;
+    page = P2V(PTE_ADDR(*pte));
+    if((mem = kalloc()) == 0)
+      return -1;
+    memmove(mem, page, PGSIZE);
+    *pte = V2P(mem) | PTE_P | PTE_W | PTE_U;
+    kfree(page);
+    lcr3(V2P(p->pgdir));
+    return 0;
+  }
+
+  // pcget() may sleep reading the file, and another thread
+  // of p may map the page meanwhile.
+  if(v->shm)
+    page = shmpage(v->shm, (va - v->start) / PGSIZE);
+  else
+    page = pcget(v->f->ip, v->off + (va - v->start));
+  if(page == 0)
+    return -1;
+  pte = walkpgdir(p->pgdir, (char*)va, 0);
+  if(pte && (*pte & PTE_P)){
+    kfree(page);
+    return 0;
+  }
+
+  perm = PTE_U;
+  if(v->prot & PROT_WRITE){
+    if(v->flags & MAP_SHARED)
+      perm |= PTE_W;
+    else if(write){
+      if((mem = kalloc()) == 0){
+        kfree(page);
+        return -1;
+      }
+      memmove(mem, page, PGSIZE);
+      kfree(page);
+      page = mem;
+      perm |= PTE_W;
+    }
+  }
+  if(mappages(p->pgdir, (char*)va, PGSIZE, V2P(page), perm) < 0){
+    kfree(page);
+    return -1;
+  }
+  return 0;
+}
+
+// Check that [addr, addr+n) lies in one of the current
+// process's regions, writable if write is set, and fault its
+// pages in now, so that a system call can use it without
+// faulting later while it holds a lock.  For a write, private
+// pages are copied here too.
+int
+vmacheck(uint addr, uint n, int write)
+{
+  struct proc *curproc = myproc();
+  struct vma *v;
+  pte_t *pte;
+  uint a;
+
+  if((v = findvma(curproc, addr)) == 0)
+    return -1;
+  if(addr + n < addr || addr + n > v->end)
+    return -1;
+  if(write && (v->prot & PROT_WRITE) == 0)
+    return -1;
+  for(a = PGROUNDDOWN(addr); a < addr + n; a += PGSIZE){
+    pte = walkpgdir(curproc->pgdir, (char*)a, 0);
+    if(pte && (*pte & PTE_P) && (!write || (*pte & PTE_W)))
+      continue;
+    if(vmafault(curproc, a, write) < 0)
+      return -1;
+  }
+  return 0;
+}
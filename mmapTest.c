@@ -0,0 +1,83 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define N 6000  // spans two pages
+
+char buf[N];
+
+void
+fail(char *what)
+{
+  printf(1, "mmapTest: %s failed\n", what);
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, i, pid;
+  char *p;
+
+  for(i = 0; i < N; i++)
+    buf[i] = 'a' + i % 26;
+  if((fd = open("mmapfile", O_CREATE|O_RDWR)) < 0)
+    fail("create");
+  if(write(fd, buf, N) != N)
+    fail("write");
+
+  // A private mapping sees the file but keeps its writes.
+  if((p = mmap(0, N, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0)) == (char*)-1)
+    fail("mmap private");
+  for(i = 0; i < N; i++)
+    if(p[i] != buf[i])
+      fail("read private");
+  p[0] = 'X';
+  if(munmap(p, N) < 0)
+    fail("munmap private");
+
+  // A shared mapping's writes reach the file, and a child
+  // shares the mapping.
+  if((p = mmap(0, N, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0)) == (char*)-1)
+    fail("mmap shared");
+  if(p[0] != 'a')
+    fail("private write stayed private");
+  if((pid = fork()) < 0)
+    fail("fork");
+  if(pid == 0){
+    p[N-1] = 'Y';
+    exit();
+  }
+  wait(0, 0, 0);
+  if(p[N-1] != 'Y')
+    fail("shared write from child");
+  p[4096] = 'Z';
+  if(munmap(p, N) < 0)
+    fail("munmap shared");
+  close(fd);
+
+  if((fd = open("mmapfile", O_RDONLY)) < 0)
+    fail("open");
+  if(read(fd, buf, N) != N)
+    fail("read");
+  if(buf[4096] != 'Z' || buf[N-1] != 'Y')
+    fail("write back");
+
+  // write() is visible through an existing mapping.
+  if((p = mmap(0, N, PROT_READ, MAP_SHARED, fd, 0)) == (char*)-1)
+    fail("mmap read-only");
+  close(fd);
+  if((fd = open("mmapfile", O_WRONLY)) < 0)
+    fail("open for write");
+  if(write(fd, "W", 1) != 1)
+    fail("write after mmap");
+  close(fd);
+  if(p[0] != 'W')
+    fail("page cache update");
+  munmap(p, N);
+
+  unlink("mmapfile");
+  printf(1, "mmapTest ok\n");
+  exit();
+}
@@ -11,6 +11,14 @@
 
 #define CR4_PSE         0x00000010      // Page size extension
 
+// Model-specific registers for sysenter
+#define MSR_SYSENTER_CS   0x174         // kernel code segment
+#define MSR_SYSENTER_ESP  0x175         // kernel stack
+#define MSR_SYSENTER_EIP  0x176         // entry point
+
+// CPUID leaf 1 %edx feature bits
+#define CPUID_SEP       0x00000800      // sysenter/sysexit
+
 // various segment selectors.
 #define SEG_KCODE 1  // kernel code
 #define SEG_KDATA 2  // kernel data+stack
@@ -83,6 +91,7 @@ struct segdesc {
 #define NPDENTRIES      1024    // # directory entries per page directory
 #define NPTENTRIES      1024    // # PTEs per page table
 #define PGSIZE          4096    // bytes mapped by a page
+#define SUPERPGSIZE     0x400000 // bytes mapped by a PTE_PS directory entry
 
 #define PTXSHIFT        12      // offset of PTX in a linear address
 #define PDXSHIFT        22      // offset of PDX in a linear address
@@ -94,15 +103,22 @@ struct segdesc {
 #define PTE_P           0x001   // Present
 #define PTE_W           0x002   // Writeable
 #define PTE_U           0x004   // User
+#define PTE_A           0x020   // Accessed
+#define PTE_D           0x040   // Dirty
 #define PTE_PS          0x080   // Page Size
+#define PTE_SWAP        0x200   // Not present, but in swap (software bit)
+
+// Page fault error code bits (tf->err)
+#define FEC_WR          0x2     // Fault caused by a write
 
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)   ((uint)(pte) & ~0xFFF)
 #define PTE_FLAGS(pte)  ((uint)(pte) &  0xFFF)
 
-#ifndef __ASSEMBLER__
-typedef uint pte_t;
+// Swap slot in a PTE_SWAP entry
+#define PTE_SLOT(pte)   (PTE_ADDR(pte) >> PTXSHIFT)
 
+#ifndef __ASSEMBLER__
 // Task state segment format
 struct taskstate {
   uint link;         // Old ts selector
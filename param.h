@@ -1,4 +1,3 @@
-#define NPROC        64  // maximum number of processes
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
@@ -9,6 +8,18 @@
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define NBUF         (LOGSIZE*3)  // fewest buffers in the disk block cache
+#define NBUFMAX    8192  // most buffers in the disk block cache
+#define BCACHEFRAC   64  // disk block cache gets 1/BCACHEFRAC of direct memory
+#define RAMIN         4  // first read-ahead window, in blocks
+#define RAMAX        32  // largest read-ahead window, in blocks
+#define FSSIZE       3000  // size of file system in blocks
 #define QUANTUM      10
+#define NSYSCALL     64  // maximum system call number
+#define NVMA          8  // mmap regions per process
+#define NPCACHE     256  // pages in the page cache
+#define NSHM         16  // shared memory segments
+#define SHMMAXPAGES  64  // pages per shared memory segment
+#define SWAPDEV       0  // device holding the swap area
+#define SWAPSTART  8192  // first block of the swap area, after the kernel
+#define SWAPSIZE  65536  // size of swap area in blocks
@@ -0,0 +1,190 @@
+// Page cache.
+//
+// Caches whole 4096-byte pages of file contents, keyed by
+// (device, inode number, file offset), for mmap().  A page is
+// filled through readi(), so the buffer cache supplies the
+// blocks, and writei() calls pcupdate() to keep cached pages
+// in step with file writes.
+//
+// Cached pages are shared with the page tables that map them
+// using the kalloc() reference counts: the cache holds one
+// reference and each mapping holds another.  An entry can be
+// recycled only when the cache's reference is the last one.
+//
+// The inode's sleep-lock serializes filling, updating and
+// invalidating the pages of that inode; pcache.lock protects
+// the hash chains and the entry keys.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+#define NPCHASH 61
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+struct pcpage {
+  uint dev;
+  uint inum;
+  uint off;            // file offset, a multiple of PGSIZE
+  char *data;          // the cached page; 0 if the entry is free
+  struct pcpage *next; // hash chain
+};
+
+struct {
+  struct spinlock lock;
+  struct pcpage page[NPCACHE];
+  struct pcpage *hash[NPCHASH];
+  int hand;            // clock hand for recycling entries
+} pcache;
+
+static uint
+pchash(uint dev, uint inum, uint off)
+{
+  return (dev * 31 + inum * 17 + off / PGSIZE) % NPCHASH;
+}
+
+void
+pcinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+}
+
+// Find the entry for (dev, inum, off).  Caller holds pcache.lock.
+static struct pcpage*
+pclookup(uint dev, uint inum, uint off)
+{
+  struct pcpage *pg;
+
+  for(pg = pcache.hash[pchash(dev, inum, off)]; pg; pg = pg->next)
+    if(pg->dev == dev && pg->inum == inum && pg->off == off)
+      return pg;
+  return 0;
+}
+
+// Take pg off its hash chain and drop the cache's reference
+// to its page.  Caller holds pcache.lock.
+static void
+pcremove(struct pcpage *pg)
+{
+  struct pcpage **pp;
+
+  for(pp = &pcache.hash[pchash(pg->dev, pg->inum, pg->off)]; *pp; pp = &(*pp)->next){
+    if(*pp == pg){
+      *pp = pg->next;
+      break;
+    }
+  }
+  kfree(pg->data);
+  pg->data = 0;
+}
+
+// Find a free entry, recycling one whose page nobody maps.
+// Caller holds pcache.lock.
+static struct pcpage*
+pcrecycle(void)
+{
+  struct pcpage *pg;
+  int i;
+
+  for(i = 0; i < 2*NPCACHE; i++){
+    pg = &pcache.page[pcache.hand];
+    pcache.hand = (pcache.hand + 1) % NPCACHE;
+    if(pg->data == 0)
+      return pg;
+    if(i >= NPCACHE && krefcount(pg->data) == 1){
+      pcremove(pg);
+      return pg;
+    }
+  }
+  return 0;
+}
+
+// Return the cached page holding ip's contents at off
+// (a multiple of PGSIZE), reading it in if necessary.
+// The caller gets its own reference to the page and must
+// kfree() it when done.  Bytes past the end of the file
+// read as zero.  ip must not be locked.
+char*
+pcget(struct inode *ip, uint off)
+{
+  struct pcpage *pg;
+  char *data;
+  uint h;
+
+  if(off % PGSIZE)
+    panic("pcget");
+
+  ilock(ip);
+  acquire(&pcache.lock);
+  if((pg = pclookup(ip->dev, ip->inum, off)) != 0){
+    data = pg->data;
+    kincref(data);
+    release(&pcache.lock);
+    iunlock(ip);
+    return data;
+  }
+  release(&pcache.lock);
+
+  // Not cached.  Holding ip's lock keeps anyone else from
+  // adding this page while we read it.
+  if((data = kzalloc()) == 0){
+    iunlock(ip);
+    return 0;
+  }
+  if(off < ip->size)
+    readi(ip, data, off, PGSIZE);
+
+  acquire(&pcache.lock);
+  if((pg = pcrecycle()) != 0){
+    pg->dev = ip->dev;
+    pg->inum = ip->inum;
+    pg->off = off;
+    pg->data = data;
+    h = pchash(pg->dev, pg->inum, pg->off);
+    pg->next = pcache.hash[h];
+    pcache.hash[h] = pg;
+    kincref(data);
+  }
+  // If every entry is mapped, hand out the page uncached.
+  release(&pcache.lock);
+  iunlock(ip);
+  return data;
+}
+
+// Copy n bytes written to ip at off into the cached pages
+// that hold them.  Called by writei(); caller holds ip->lock.
+void
+pcupdate(struct inode *ip, uint off, char *src, uint n)
+{
+  struct pcpage *pg;
+  uint m;
+
+  acquire(&pcache.lock);
+  for(; n > 0; n -= m, off += m, src += m){
+    m = min(n, PGSIZE - off%PGSIZE);
+    pg = pclookup(ip->dev, ip->inum, PGROUNDDOWN(off));
+    if(pg && pg->data + off%PGSIZE != src)
+      memmove(pg->data + off%PGSIZE, src, m);
+  }
+  release(&pcache.lock);
+}
+
+// Forget ip's cached pages; its contents are going away.
+// Pages that are still mapped live on until unmapped.
+// Caller holds ip->lock.
+void
+pcinval(struct inode *ip)
+{
+  struct pcpage *pg;
+
+  acquire(&pcache.lock);
+  for(pg = pcache.page; pg < &pcache.page[NPCACHE]; pg++)
+    if(pg->data && pg->dev == ip->dev && pg->inum == ip->inum)
+      pcremove(pg);
+  release(&pcache.lock);
+}
@@ -7,12 +7,39 @@
 #include "proc.h"
 #include "spinlock.h"
 #include "stddef.h"
-
+#include "kstat.h"
+#include "slab.h"
+
+#define NPIDHASH 64
+#define NFREEPROC 32  // reaped procs kept for reuse
+
+// Processes are allocated from proccache as they are created
+// and freed when reaped, so there is no fixed limit on their
+// number.  Every process is on the ptable list, oldest first,
+// and in a pid hash chain; each also lists its running and
+// its exited children separately.
+// Up to NFREEPROC reaped procs wait on a free stack, still
+// holding their kernel stacks, so that allocproc() usually
+// needs neither allocator.  ptable.lock protects all of these
+// links.
 struct {
   struct spinlock lock;
-  struct proc proc[NPROC];
+  struct proc *head;
+  struct proc *tail;
+  int nproc;
+  struct proc *pidhash[NPIDHASH];
+  struct proc *free;
+  int nfree;
 } ptable;
 
+static struct kmemcache proccache;
+
+// Clock hand for evictpage(): a process and a user address.
+static struct {
+  struct proc *p;
+  uint va;
+} hand;
+
 uint multiLayeredFlag=0;
 
 static struct proc *initproc;
@@ -28,6 +55,7 @@ void
 pinit(void)
 {
   initlock(&ptable.lock, "ptable");
+  kmcacheinit(&proccache, "proc", sizeof(struct proc));
 }
 
 // Must be called with interrupts disabled
@@ -70,41 +98,35 @@ myproc(void) {
 }
 
 //PAGEBREAK: 32
-// Look in the process table for an UNUSED proc.
-// If found, change state to EMBRYO and initialize
-// state required to run in the kernel.
-// Otherwise return 0.
+// Allocate a new proc, in state EMBRYO with what it
+// needs to run in the kernel, and add it to the process
+// table.  Returns 0 if out of memory.
 static struct proc*
 allocproc(void)
 {
   struct proc *p;
-  char *sp;
+  char *sp, *kstack;
 
   acquire(&ptable.lock);
-
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == UNUSED)
-      goto found;
-
-  release(&ptable.lock);
-  return 0;
-
-found:
- 
-  p->creationTime=ticks;//// changed
-  p->state = EMBRYO;
-  p->pid = nextpid++;
-  ///alt
-
-  p->priority=3; ////default priority
-  p->queqeNumber=1;
-  ////alt
+  if((p = ptable.free) != 0){
+    ptable.free = p->next;
+    ptable.nfree--;
+  }
   release(&ptable.lock);
 
-  // Allocate kernel stack.
-  if((p->kstack = kalloc()) == 0){
-    p->state = UNUSED;
-    return 0;
+  if(p){
+    kstack = p->kstack;
+    memset(p, 0, sizeof(*p));
+    p->kstack = kstack;
+  } else {
+    if((p = kmcalloc(&proccache)) == 0)
+      return 0;
+    memset(p, 0, sizeof(*p));
+    // Allocate kernel stack.
+    if((p->kstack = kalloc()) == 0){
+      kmcfree(&proccache, p);
+      return 0;
+    }
   }
   sp = p->kstack + KSTACKSIZE;
 
@@ -122,9 +144,132 @@ found:
   memset(p->context, 0, sizeof *p->context);
   p->context->eip = (uint)forkret;
 
+  ///alt
+  p->priority=3; ////default priority
+  p->queqeNumber=1;
+  ////alt
+
+  acquire(&ptable.lock);
+  p->creationTime=ticks;//// changed
+  p->state = EMBRYO;
+  p->pid = nextpid++;
+  p->prev = ptable.tail;
+  if(ptable.tail)
+    ptable.tail->next = p;
+  else
+    ptable.head = p;
+  ptable.tail = p;
+  p->hnext = ptable.pidhash[p->pid % NPIDHASH];
+  ptable.pidhash[p->pid % NPIDHASH] = p;
+  ptable.nproc++;
+  release(&ptable.lock);
+
   return p;
 }
 
+// Add p to the front of a list of children, *head.
+static void
+kidadd(struct proc **head, struct proc *p)
+{
+  p->sibprev = 0;
+  p->sibling = *head;
+  if(*head)
+    (*head)->sibprev = p;
+  *head = p;
+}
+
+// Remove p from the list of children *head.
+static void
+kiddel(struct proc **head, struct proc *p)
+{
+  if(p->sibprev)
+    p->sibprev->sibling = p->sibling;
+  else
+    *head = p->sibling;
+  if(p->sibling)
+    p->sibling->sibprev = p->sibprev;
+}
+
+// Hand the list of children *from to init, adding it to the
+// front of init's list *to.  Returns whether it had any.
+static int
+kidsplice(struct proc **from, struct proc **to)
+{
+  struct proc *p;
+
+  if((p = *from) == 0)
+    return 0;
+  for(;;){
+    p->parent = initproc;
+    if(p->pgdir)
+      setvproc(p->pgdir, p->pid, initproc->pid);
+    if(p->sibling == 0)
+      break;
+    p = p->sibling;
+  }
+  p->sibling = *to;
+  if(*to)
+    (*to)->sibprev = p;
+  *to = *from;
+  *from = 0;
+  return 1;
+}
+
+// Take p off the process table and its parent's list of
+// children, free its page table, and put it on the free
+// stack or free it with its kernel stack.
+// Caller must hold ptable.lock.
+static void
+freeproc(struct proc *p)
+{
+  struct proc **pp;
+
+  if(p->parent)
+    kiddel(p->state == ZOMBIE ? &p->parent->zombie : &p->parent->child, p);
+  for(pp = &ptable.pidhash[p->pid % NPIDHASH]; *pp != p; pp = &(*pp)->hnext)
+    ;
+  *pp = p->hnext;
+  if(p->prev)
+    p->prev->next = p->next;
+  else
+    ptable.head = p->next;
+  if(p->next)
+    p->next->prev = p->prev;
+  else
+    ptable.tail = p->prev;
+  ptable.nproc--;
+  if(hand.p == p){
+    hand.p = p->next;
+    hand.va = 0;
+  }
+
+  if(p->pgdir)
+    freevm(p->pgdir);
+  p->pgdir = 0;
+  p->state = UNUSED;
+  if(ptable.nfree < NFREEPROC){
+    p->next = ptable.free;
+    ptable.free = p;
+    ptable.nfree++;
+    return;
+  }
+  kfree(p->kstack);
+  kmcfree(&proccache, p);
+}
+
+// Return the process with the given pid, or 0.
+// Caller must hold ptable.lock.
+static struct proc*
+findproc(int pid)
+{
+  struct proc *p;
+
+  for(p = ptable.pidhash[(uint)pid % NPIDHASH]; p; p = p->hnext)
+    if(p->pid == pid)
+      return p;
+  return 0;
+}
+
 //PAGEBREAK: 32
 // Set up first user process.
 void
@@ -139,6 +284,9 @@ userinit(void)
   if((p->pgdir = setupkvm()) == 0)
     panic("userinit: out of memory?");
   inituvm(p->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
+  if(allocvproc(p->pgdir) < 0)
+    panic("userinit: out of memory?");
+  setvproc(p->pgdir, p->pid, 0);
   p->sz = PGSIZE;
   memset(p->tf, 0, sizeof(*p->tf));
   p->tf->cs = (SEG_UCODE << 3) | DPL_USER;
@@ -165,6 +313,90 @@ userinit(void)
   release(&ptable.lock);
 }
 
+// Wait until no other CPU may still have stale TLB entries
+// for pgdir: each one running a process has reloaded %cr3
+// since its tlbstale was set.
+static void
+tlbwait(pde_t *pgdir)
+{
+  struct cpu *c;
+
+  for(;;){
+    acquire(&ptable.lock);
+    for(c = cpus; c < cpus+ncpu; c++)
+      if(c->pgdir == pgdir && c->tlbstale && c->proc)
+        break;
+    release(&ptable.lock);
+    if(c == cpus+ncpu)
+      return;
+    yield();
+  }
+}
+
+// Shrink current process's memory by n bytes.  Threads
+// sharing the page table may be running on other CPUs with
+// the pages in their TLBs, so the pages are unmapped a batch
+// at a time, and a batch is freed only once those CPUs have
+// reloaded %cr3.  Swap slots in the batch are freed then too,
+// outside ptable.lock.  Return 0 on success, -1 on failure.
+static int
+shrinkproc(uint n)
+{
+  struct proc *curproc = myproc();
+  struct proc *p;
+  struct cpu *c;
+  pte_t batch[64], *ptes;
+  uint sz, newsz;
+  char *mem;
+  int i, max, nptes;
+
+  ptes = batch;
+  max = NELEM(batch);
+  if(n > max*PGSIZE && (mem = kalloc()) != 0){
+    ptes = (pte_t*)mem;
+    max = PGSIZE/sizeof(pte_t);
+  }
+
+  acquire(&ptable.lock);
+  if(n > curproc->sz){
+    release(&ptable.lock);
+    if(ptes != batch)
+      kfree((char*)ptes);
+    return -1;
+  }
+  newsz = curproc->sz - n;
+  for(;;){
+    sz = unmapuvm(curproc->pgdir, curproc->sz, newsz, ptes, max, &nptes);
+    for(p = ptable.head; p; p = p->next)
+      if(p->pgdir == curproc->pgdir)
+        p->sz = sz;
+    for(c = cpus; c < cpus+ncpu; c++)
+      if(c->pgdir == curproc->pgdir)
+        c->tlbstale = 1;
+    mycpu()->tlbstale = 0;
+    lcr3(V2P(curproc->pgdir));  // flush the TLB
+    release(&ptable.lock);
+
+    tlbwait(curproc->pgdir);
+    for(i = 0; i < nptes; i++){
+      if(ptes[i] & PTE_SWAP)
+        swapfree(PTE_SLOT(ptes[i]));
+      else
+        ufree(PTE_ADDR(ptes[i]));
+    }
+
+    // Stop if done, or if another thread changed the size
+    // meanwhile.
+    acquire(&ptable.lock);
+    if(sz == newsz || curproc->sz != sz)
+      break;
+  }
+  release(&ptable.lock);
+  if(ptes != batch)
+    kfree((char*)ptes);
+  return 0;
+}
+
 // Grow current process's memory by n bytes.
 // Return 0 on success, -1 on failure.
 int
@@ -172,18 +404,36 @@ growproc(int n)
 {
   uint sz;
   struct proc *curproc = myproc();
+  struct proc *p;
 
+  // Make room first: swapping pages out sleeps, which
+  // it cannot do under ptable.lock.
+  if(n > 0)
+    reclaim(PGROUNDUP((uint)n) / PGSIZE);
+  // ptable.lock keeps threads sharing the page table from
+  // growing it at the same time, and lets us update their sz.
+  acquire(&ptable.lock);
   sz = curproc->sz;
   if(n > 0){
+    // The heap may not grow into the mmap() regions.
+    if(sz + n < sz || sz + n > vmabase(curproc))
+      goto bad;
     if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
-      return -1;
+      goto bad;
   } else if(n < 0){
-    if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
-      return -1;
+    release(&ptable.lock);
+    return shrinkproc(-n);
   }
-  curproc->sz = sz;
-  switchuvm(curproc);
+  for(p = ptable.head; p; p = p->next)
+    if(p->pgdir == curproc->pgdir)
+      p->sz = sz;
+  release(&ptable.lock);
+  lcr3(V2P(curproc->pgdir));  // flush the TLB
   return 0;
+
+bad:
+  release(&ptable.lock);
+  return -1;
 }
 
 // Create a new process copying p as the parent.
@@ -202,14 +452,23 @@ fork(void)
   }
 
   // Copy process state from proc.
-  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
-    kfree(np->kstack);
-    np->kstack = 0;
-    np->state = UNUSED;
+  reclaim(curproc->sz / PGSIZE);
+  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0 ||
+     allocvproc(np->pgdir) < 0){
+    acquire(&ptable.lock);
+    freeproc(np);
+    release(&ptable.lock);
     return -1;
   }
+  setvproc(np->pgdir, np->pid, curproc->pid);
   np->sz = curproc->sz;
-  np->parent = curproc;
+  if(vmadup(np, curproc) < 0){
+    vmaunmapall(np);
+    acquire(&ptable.lock);
+    freeproc(np);
+    release(&ptable.lock);
+    return -1;
+  }
   *np->tf = *curproc->tf;
 
   // Clear %eax so that fork returns 0 in the child.
@@ -226,6 +485,8 @@ fork(void)
 
   acquire(&ptable.lock);
 
+  np->parent = curproc;
+  kidadd(&curproc->child, np);
   np->state = RUNNABLE;
   
 
@@ -235,6 +496,217 @@ fork(void)
   return pid;
 }
 
+// Return whether another process shares p's page table.
+int
+sharedpgdir(struct proc *p)
+{
+  struct proc *q;
+  int shared;
+
+  shared = 0;
+  acquire(&ptable.lock);
+  for(q = ptable.head; q; q = q->next)
+    if(q != p && q->pgdir == p->pgdir)
+      shared = 1;
+  release(&ptable.lock);
+  return shared;
+}
+
+// Can p's pages be swapped out?  Not while a process using
+// its page table is running or in a system call: kernel code
+// may be using the pages, perhaps holding a spinlock, when
+// it could not fault them back in.  argptr() brings in the
+// pages a system call will use before it starts.
+static int
+swappable(struct proc *p)
+{
+  struct proc *q;
+
+  if(p->state != RUNNABLE && p->state != SLEEPING)
+    return 0;
+  for(q = ptable.head; q; q = q->next){
+    if(q->pgdir != p->pgdir || q->state == ZOMBIE)
+      continue;
+    if(q->state == RUNNING || q->insyscall)
+      return 0;
+  }
+  return 1;
+}
+
+// Choose a cold user page with the clock algorithm and
+// unmap it, leaving swap slot slot in its PTE.  The hand
+// sweeps the pages of swappable processes, clearing accessed
+// bits, and stops at the first page whose bit was already
+// clear.  Returns the page's page table, with a reference the
+// caller drops with freevm() once the page is written out,
+// and sets *pa to the page; or returns 0 if there is no page
+// to evict.
+pde_t*
+evictpage(uint slot, uint *pa)
+{
+  struct proc *p;
+  struct cpu *c;
+  pte_t *pte;
+  int i;
+
+  acquire(&ptable.lock);
+  // Twice around, since the first pass may only clear bits.
+  for(i = 0; i <= 2*ptable.nproc; i++){
+    if(hand.p == 0){
+      hand.p = ptable.head;
+      hand.va = 0;
+    }
+    p = hand.p;
+    if(!swappable(p))
+      hand.va = p->sz;
+    for(; hand.va < p->sz; hand.va += PGSIZE){
+      if((pte = walkpgdir(p->pgdir, (char*)hand.va, 0)) == 0){
+        hand.va = PGADDR(PDX(hand.va) + 1, 0, 0) - PGSIZE;
+        continue;
+      }
+      if((*pte & (PTE_P|PTE_U)) != (PTE_P|PTE_U))
+        continue;
+      if(*pte & PTE_A){
+        *pte &= ~PTE_A;
+        continue;
+      }
+      *pa = PTE_ADDR(*pte);
+      *pte = (slot << PTXSHIFT) | (*pte & (PTE_W|PTE_U)) | PTE_SWAP;
+      hand.va += PGSIZE;
+      // A CPU that still has the page table loaded may have
+      // the old mapping in its TLB.
+      for(c = cpus; c < cpus+ncpu; c++)
+        if(c->pgdir == p->pgdir)
+          c->tlbstale = 1;
+      kincref((char*)p->pgdir);
+      release(&ptable.lock);
+      return p->pgdir;
+    }
+    hand.p = p->next;
+    hand.va = 0;
+  }
+  release(&ptable.lock);
+  return 0;
+}
+
+// Create a thread: a new process that shares the current
+// process's page table, running fcn(arg1, arg2) on the
+// one-page user stack at stack.  Its open files and current
+// directory are the parent's, with references of its own.
+// The thread ends by calling exit(), and the parent collects
+// it with join().  Returns the new thread's pid, or -1.
+int
+clone(uint fcn, uint arg1, uint arg2, uint stack)
+{
+  int i, pid;
+  struct proc *np;
+  struct proc *curproc = myproc();
+  uint ustack[3];
+  struct vma *v;
+
+  // mmap() regions are per process; see vmaalloc().
+  for(v = curproc->vma; v < &curproc->vma[NVMA]; v++)
+    if(v->start)
+      return -1;
+
+  if((np = allocproc()) == 0)
+    return -1;
+
+  // The page table gets a kalloc() reference per user;
+  // freevm() drops it.
+  kincref((char*)curproc->pgdir);
+  np->pgdir = curproc->pgdir;
+  setvproc(np->pgdir, -1, -1);
+  np->sz = curproc->sz;
+  np->ustack = (char*)stack;
+  *np->tf = *curproc->tf;
+
+  // Start at fcn, with a fake return PC and the two arguments
+  // at the top of the new stack.
+  ustack[0] = 0xffffffff;
+  ustack[1] = arg1;
+  ustack[2] = arg2;
+  np->tf->esp = stack + PGSIZE - sizeof(ustack);
+  memmove((char*)np->tf->esp, ustack, sizeof(ustack));
+  np->tf->eip = fcn;
+
+  for(i = 0; i < NOFILE; i++)
+    if(curproc->ofile[i])
+      np->ofile[i] = filedup(curproc->ofile[i]);
+  np->cwd = idup(curproc->cwd);
+
+  safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+
+  pid = np->pid;
+
+  acquire(&ptable.lock);
+  np->parent = curproc;
+  kidadd(&curproc->child, np);
+  np->state = RUNNABLE;
+  release(&ptable.lock);
+
+  return pid;
+}
+
+// Create a child process running the program at path with
+// arguments argv, as fork() and exec() would but without
+// copying the parent's memory first.  If fds is not 0, the
+// child's descriptors 0, 1 and 2 are the parent's fds[0],
+// fds[1] and fds[2] (-1 leaves one closed) and it gets no
+// others; otherwise it inherits all of them.  The caller has
+// checked that the descriptors in fds are open.  Returns the
+// child's pid, or -1.
+int
+spawn(char *path, char **argv, int *fds)
+{
+  int i, pid;
+  uint entry, sp;
+  struct proc *np;
+  struct proc *curproc = myproc();
+
+  if((np = allocproc()) == 0)
+    return -1;
+  if((np->pgdir = loadimage(path, argv, &np->sz, &entry, &sp)) == 0){
+    acquire(&ptable.lock);
+    freeproc(np);
+    release(&ptable.lock);
+    return -1;
+  }
+  setvproc(np->pgdir, np->pid, curproc->pid);
+
+  memset(np->tf, 0, sizeof(*np->tf));
+  np->tf->cs = (SEG_UCODE << 3) | DPL_USER;
+  np->tf->ds = (SEG_UDATA << 3) | DPL_USER;
+  np->tf->es = np->tf->ds;
+  np->tf->ss = np->tf->ds;
+  np->tf->eflags = FL_IF;
+  np->tf->esp = sp;
+  np->tf->eip = entry;  // main
+
+  if(fds){
+    for(i = 0; i < 3; i++)
+      if(fds[i] >= 0)
+        np->ofile[i] = filedup(curproc->ofile[fds[i]]);
+  } else {
+    for(i = 0; i < NOFILE; i++)
+      if(curproc->ofile[i])
+        np->ofile[i] = filedup(curproc->ofile[i]);
+  }
+  np->cwd = idup(curproc->cwd);
+
+  setprocname(np, path);
+
+  pid = np->pid;
+
+  acquire(&ptable.lock);
+  np->parent = curproc;
+  kidadd(&curproc->child, np);
+  np->state = RUNNABLE;
+  release(&ptable.lock);
+
+  return pid;
+}
+
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait() to find out it exited.
@@ -242,12 +714,14 @@ void
 exit(void)
 {
   struct proc *curproc = myproc();
-  struct proc *p;
   int fd;
 
   if(curproc == initproc)
     panic("init exiting");
 
+  // Unmap mmap() regions, writing back dirty shared pages.
+  vmaunmapall(curproc);
+
   // Close all open files.
   for(fd = 0; fd < NOFILE; fd++){
     if(curproc->ofile[fd]){
@@ -265,15 +739,13 @@ exit(void)
 
   // Parent might be sleeping in wait().
   wakeup1(curproc->parent);
+  kiddel(&curproc->parent->child, curproc);
+  kidadd(&curproc->parent->zombie, curproc);
 
   // Pass abandoned children to init.
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->parent == curproc){
-      p->parent = initproc;
-      if(p->state == ZOMBIE)
-        wakeup1(initproc);
-    }
-  }
+  kidsplice(&curproc->child, &initproc->child);
+  if(kidsplice(&curproc->zombie, &initproc->zombie))
+    wakeup1(initproc);
 
   // Jump into the scheduler, never to return.
   /////alt
@@ -290,62 +762,54 @@ int
 wait(int * cpuBurst , int * turnaround , int * waiting)
 {
   struct proc *p;
-  int havekids, pid;
+  int havekids, pid, queqeNumber, priority;
   struct proc *curproc = myproc();
  // int counter=0;
   acquire(&ptable.lock);
   for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    // Exited children are on the zombie list, usually first.
+    for(p = curproc->zombie; p; p = p->sibling){
       //counter++;
-      if(p->parent != curproc)
+      // Threads sharing our page table are for join().
+      if(p->pgdir == curproc->pgdir)
         continue;
-      havekids = 1;
       //cprintf("cbt before zombie %d",p->runningTime);
-      if(p->state == ZOMBIE){
 
-        if(policy == 1 || policy==2 || policy==3){
-          
-          *cpuBurst=p->runningTime;
-          *turnaround=p->readyTime + p->sleepingTime + p->runningTime;
-          *waiting=p->readyTime + p->sleepingTime;
-        }
-        // Found one.
-       // cprintf("cbt after zombie %d",p->runningTime);
-        pid = p->pid;
-        kfree(p->kstack);
-        p->kstack = 0;
-        freevm(p->pgdir);
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-        p->runningTime=0;
-        p->readyTime=0;
-        p->sleepingTime=0;
-        p->state = UNUSED;
-        release(&ptable.lock);
-          ////for multiLayeredScheduling
+      if(policy == 1 || policy==2 || policy==3){
         
-          if(multiLayeredFlag!=0)
-            return p->queqeNumber;
+        *cpuBurst=p->runningTime;
+        *turnaround=p->readyTime + p->sleepingTime + p->runningTime;
+        *waiting=p->readyTime + p->sleepingTime;
+      }
+      // Found one.
+     // cprintf("cbt after zombie %d",p->runningTime);
+      pid = p->pid;
+      queqeNumber = p->queqeNumber;
+      priority = p->priority;
+      freeproc(p);
+      release(&ptable.lock);
+        ////for multiLayeredScheduling
+      
+        if(multiLayeredFlag!=0)
+          return queqeNumber;
 
-          else{
+        else{
 
-            if(policy==2 || policy==3)
-              return p->priority;
+          if(policy==2 || policy==3)
+            return priority;
 
-            if(policy==0 || policy==1)
-              return pid;
+          return pid;
 
 
-          }
+        }
 
-      }
     }
 
     // No point waiting if we don't have any children.
+    havekids = 0;
+    for(p = curproc->child; p && !havekids; p = p->sibling)
+      if(p->pgdir != curproc->pgdir)
+        havekids = 1;
     if(!havekids || curproc->killed){
       release(&ptable.lock);
       return -1;
@@ -356,8 +820,55 @@ wait(int * cpuBurst , int * turnaround , int * waiting)
   }
 }
 
+// Wait for a thread made by clone() to exit and return its
+// pid, storing the user stack it was given in *stack so the
+// caller can free it.  Return -1 if there are no threads.
+int
+join(void **stack)
+{
+  struct proc *p;
+  int havekids, pid;
+  struct proc *curproc = myproc();
+
+  acquire(&ptable.lock);
+  for(;;){
+    for(p = curproc->zombie; p; p = p->sibling){
+      if(p->pgdir != curproc->pgdir)
+        continue;
+      pid = p->pid;
+      *stack = p->ustack;
+      freeproc(p);
+      release(&ptable.lock);
+      return pid;
+    }
+
+    havekids = 0;
+    for(p = curproc->child; p && !havekids; p = p->sibling)
+      if(p->pgdir == curproc->pgdir)
+        havekids = 1;
+    if(!havekids || curproc->killed){
+      release(&ptable.lock);
+      return -1;
+    }
+    sleep(curproc, &ptable.lock);
+  }
+}
+
 
 
+// Add up the scheduler's context switch counts over all CPUs.
+void
+kswitchstat(struct kswitchstat *st)
+{
+  struct cpu *c;
+
+  st->nswitch = st->ncr3 = 0;
+  for(c = cpus; c < &cpus[ncpu]; c++){
+    st->nswitch += c->nswitch;
+    st->ncr3 += c->ncr3;
+  }
+}
+
 //PAGEBREAK: 42
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
@@ -437,6 +948,7 @@ scheduler(void)
     c->proc = 0;
     int i=1;
     int found=0;
+    int ran;
     struct proc *iterator;  //added by us
     for(;;){
       // Enable interrupts on this processor.
@@ -445,15 +957,16 @@ scheduler(void)
     struct proc *highestPriority;/////////////////////////////////
       // Loop over process table looking for process to run.
       i=1;
+      ran=0;
       acquire(&ptable.lock);
       if(multiLayeredFlag==0){
-        for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+        for(p = ptable.head; p; p = p->next){
           if(p->state != RUNNABLE)
             continue;
         if(policy ==2){
           highestPriority=p;////////////////////
 
-          for(iterator= ptable.proc; iterator < &ptable.proc[NPROC]; iterator++){////////// find the highest priority
+          for(iterator= ptable.head; iterator; iterator = iterator->next){////////// find the highest priority
             if(iterator->state != RUNNABLE)
               continue;
             if((iterator->priority)<(highestPriority->priority))
@@ -476,8 +989,9 @@ scheduler(void)
             p->current_slice = QUANTUM; ///ADDED BY US
 
           ///alt
+          ran=1;
+          c->nswitch++;
           swtch(&(c->scheduler), p->context);
-          switchkvm();
 
           // Process is done running for now.
           // It should have changed its p->state before coming back.
@@ -513,7 +1027,7 @@ scheduler(void)
       struct proc *highestPriority;/////////////////////////////////
       // Loop over process table looking for process to run.
       found=0;
-      for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+      for(p = ptable.head; p; p = p->next){
         if(p->state != RUNNABLE || p->queqeNumber!=i)
           continue;
           
@@ -524,7 +1038,7 @@ scheduler(void)
          
           highestPriority=p;////////////////////
 
-          for(iterator= ptable.proc; iterator < &ptable.proc[NPROC]; iterator++){////////// find the highest priority
+          for(iterator= ptable.head; iterator; iterator = iterator->next){////////// find the highest priority
             if(iterator->state != RUNNABLE || p->queqeNumber!=i)
               continue;
             if(policy==2) { 
@@ -555,8 +1069,9 @@ scheduler(void)
           p->current_slice = QUANTUM; ///ADDED BY US
 
         ///alt
+        ran=1;
+        c->nswitch++;
         swtch(&(c->scheduler), p->context);
-        switchkvm();
 
         // Process is done running for now.
         // It should have changed its p->state before coming back.
@@ -574,6 +1089,11 @@ scheduler(void)
       }
       release(&ptable.lock);
 
+      // Nothing to run: use the idle time to zero free pages.
+      if(!ran){
+        switchkvmidle();
+        kzrefill();
+      }
     }
 
 
@@ -692,7 +1212,7 @@ wakeup1(void *chan)
 {
   struct proc *p;
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+  for(p = ptable.head; p; p = p->next){
     if(p->state == SLEEPING && p->chan == chan){
       p->state = RUNNABLE;
      
@@ -719,16 +1239,14 @@ kill(int pid)
   struct proc *p;
 
   acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == pid){
-      p->killed = 1;
-      // Wake process from sleep if necessary.
-      if(p->state == SLEEPING){
-        p->state = RUNNABLE;
-      }
-      release(&ptable.lock);
-      return 0;
+  if((p = findproc(pid)) != 0){
+    p->killed = 1;
+    // Wake process from sleep if necessary.
+    if(p->state == SLEEPING){
+      p->state = RUNNABLE;
     }
+    release(&ptable.lock);
+    return 0;
   }
   release(&ptable.lock);
   return -1;
@@ -754,9 +1272,7 @@ procdump(void)
   char *state;
   uint pc[10];
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->state == UNUSED)
-      continue;
+  for(p = ptable.head; p; p = p->next){
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
       state = states[p->state];
     else
@@ -805,7 +1321,7 @@ void processingTimeVariables(void){
   struct proc *p;
 
   acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    for(p = ptable.head; p; p = p->next){
 
       switch (p->state){
 
@@ -842,15 +1358,18 @@ int getChildren(){
 
   struct proc *p;
   struct proc *curproc = myproc();
+  struct proc *kids[2];
+  int k;
   int counter=0;
   int multiplier=1;
   int children=0;
  
   acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+  kids[0] = curproc->child;
+  kids[1] = curproc->zombie;
+  for(k = 0; k < 2; k++)
+  for(p = kids[k]; p; p = p->sibling){
 
-    if((p->parent->pid) == (curproc->pid)){
-      
       for(int i=1 ; i<=counter ; i++){
 
           multiplier*=100;
@@ -861,7 +1380,6 @@ int getChildren(){
       children+=((p->pid) * multiplier);
       multiplier=1;
       counter++;
-    }
     
   }
   release(&ptable.lock);
@@ -908,20 +1426,15 @@ int changePolicy(int plcy){
 
 int getPriorityOfPID(int ID){
   struct proc *p;
+  int priority;
   
+  priority = -1;
   acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-        
-        if(p->pid == ID){
-
-          break;
-        }
-      
-    
-  }
+  if((p = findproc(ID)) != 0)
+    priority = p->priority;
   release(&ptable.lock);
 
-  return p->priority;
+  return priority;
 }
 
 
@@ -8,6 +8,11 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  pde_t *pgdir;                // Page table loaded in %cr3, or 0 for kpgdir
+  uint nswitch;                // Processes run by the scheduler
+  uint ncr3;                   // Page table switches (TLB flushes) among them
+  int ntmpmap;                 // High memory pages mapped by tmpmap()
+  int tlbstale;                // A page in pgdir was swapped out
 };
 
 extern struct cpu cpus[NCPU];
@@ -39,6 +44,17 @@ struct Node {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// A region of the address space set up by mmap() or shmat().
+struct vma {
+  uint start;                  // First address, or 0 if unused
+  uint end;                    // One past the last address
+  int prot;                    // PROT_READ, PROT_WRITE
+  int flags;                   // MAP_SHARED or MAP_PRIVATE
+  struct file *f;              // Mapped file, or 0
+  uint off;                    // File offset of start
+  struct shmseg *shm;          // Attached shared memory segment, or 0
+};
+
 // Per-process state
 struct proc {
  
@@ -49,6 +65,13 @@ struct proc {
   enum procstate state;        // Process state
   int pid;                     // Process ID
   struct proc *parent;         // Parent process
+  struct proc *child;          // First running child
+  struct proc *zombie;         // First exited child, for wait()
+  struct proc *sibling;        // Next on parent's child or zombie list
+  struct proc *sibprev;
+  struct proc *next;           // Process table list
+  struct proc *prev;
+  struct proc *hnext;          // Pid hash chain
   struct trapframe *tf;        // Trap frame for current syscall
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
@@ -56,7 +79,7 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
-  int numsyscall[30];
+  int numsyscall[NSYSCALL];
   int current_slice;
   int priority;
   int creationTime;
@@ -65,6 +88,9 @@ struct proc {
   int readyTime;
   int sleepingTime;
   int queqeNumber;
+  struct vma vma[NVMA];        // mmap regions
+  char *ustack;                // User stack given to clone(), for join()
+  int insyscall;               // In a system call, so pages may not be swapped
 
 };
 
@@ -73,3 +99,5 @@ struct proc {
 //   original data and bss
 //   fixed-size stack
 //   expandable heap
+// mmap() and shmat() regions are placed top-down from MMAPTOP,
+// and the heap cannot grow into them.
@@ -0,0 +1,53 @@
+// Read files from start to end, 512 bytes at a time as cat
+// and wc do, and report the cost per block along with how
+// many blocks came from the disk and how many of those were
+// read ahead.  Run it on files not read since boot to see
+// the disk: the buffer cache keeps anything read before.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "kstat.h"
+
+char buf[512];
+
+void
+readfile(char *path)
+{
+  struct kbufstat s0, s1;
+  uint t0, t1;
+  int fd, n, nblock;
+
+  if((fd = open(path, 0)) < 0){
+    printf(1, "readbench: cannot open %s\n", path);
+    return;
+  }
+  kbufstat(&s0);
+  t0 = rdtsc();
+  nblock = 0;
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    nblock++;
+  t1 = rdtsc();
+  kbufstat(&s1);
+  close(fd);
+  if(nblock == 0)
+    nblock = 1;
+  printf(1, "%s: %d blocks, %d cycles per block, %d disk reads, "
+         "%d read ahead\n", path, nblock, (t1 - t0) / nblock,
+         s1.nread - s0.nread, s1.nreadahead - s0.nreadahead);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i;
+
+  if(argc < 2){
+    readfile("usertests");
+    exit();
+  }
+  for(i = 1; i < argc; i++)
+    readfile(argv[i]);
+  exit();
+}
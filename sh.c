@@ -53,6 +53,7 @@ struct backcmd {
 int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
+int simplecmd(char*);
 
 // Execute cmd.  Never returns.
 void
@@ -147,6 +148,8 @@ main(void)
 {
   static char buf[100];
   int fd;
+  struct cmd *cmd;
+  struct execcmd *ecmd;
 
   // Ensure that three file descriptors are open.
   while((fd = open("console", O_RDWR)) >= 0){
@@ -165,6 +168,19 @@ main(void)
         printf(2, "cannot cd %s\n", buf+3);
       continue;
     }
+    if(simplecmd(buf)){
+      // A simple command needs no copy of the shell.
+      cmd = parsecmd(buf);
+      ecmd = (struct execcmd*)cmd;
+      if(ecmd->argv[0]){
+        if(spawn(ecmd->argv[0], ecmd->argv, 0) < 0)
+          printf(2, "exec %s failed\n", ecmd->argv[0]);
+        else
+          wait(NULL,NULL,NULL);
+      }
+      free(cmd);
+      continue;
+    }
     if(fork1() == 0)
       runcmd(parsecmd(buf));
     wait(NULL,NULL,NULL);
@@ -263,6 +279,25 @@ backcmd(struct cmd *subcmd)
 char whitespace[] = " \t\r\n\v";
 char symbols[] = "<|>&;()";
 
+// Is buf just a command and its arguments, with no redirection,
+// pipes or lists?  Then the shell can parse it itself, sure
+// that parsing will not fail, and spawn() it.
+int
+simplecmd(char *buf)
+{
+  char *s;
+  int n;
+
+  n = 0;
+  for(s = buf; *s; s++){
+    if(strchr(symbols, *s))
+      return 0;
+    if(!strchr(whitespace, *s) && (s == buf || strchr(whitespace, s[-1])))
+      n++;
+  }
+  return n < MAXARGS;
+}
+
 int
 gettoken(char **ps, char *es, char **q, char **eq)
 {
@@ -0,0 +1,223 @@
+// Shared memory segments.
+//
+// shmget() finds or creates a segment of zeroed pages by key,
+// and shmat() maps it into the calling process as an mmap()
+// region (see mmap.c), so fork() passes it to the child and
+// exit() and exec() detach it.  The segment holds one kalloc()
+// reference to each page and every mapping holds another.
+// A segment is destroyed when the last region attached to it
+// goes away, or by shmrm() if none is; a segment that is never
+// attached must be removed with shmrm().
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "fcntl.h"
+
+struct shmseg {
+  int key;
+  int ref;                   // regions attached to the segment
+  int npages;                // 0 if the slot is free
+  int creating;              // shmget() is allocating the pages
+  char *pages[SHMMAXPAGES];
+};
+
+struct {
+  struct spinlock lock;
+  struct shmseg seg[NSHM];
+} shmtable;
+
+void
+shminit(void)
+{
+  initlock(&shmtable.lock, "shm");
+}
+
+static void
+freepages(char **pages, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    kfree(pages[i]);
+}
+
+// Return the id of the segment with the given key, creating
+// it with size bytes if there is none.  An existing segment
+// must be at least size bytes long.
+int
+shmget(int key, uint size)
+{
+  struct shmseg *s, *free;
+  char *pages[SHMMAXPAGES];
+  int i, n;
+
+  n = PGROUNDUP(size) / PGSIZE;
+  if(key <= 0 || n == 0 || n > SHMMAXPAGES)
+    return -1;
+
+  acquire(&shmtable.lock);
+again:
+  free = 0;
+  for(s = shmtable.seg; s < &shmtable.seg[NSHM]; s++){
+    if(s->npages == 0){
+      if(free == 0)
+        free = s;
+    } else if(s->key == key){
+      if(s->creating){
+        sleep(s, &shmtable.lock);
+        goto again;
+      }
+      release(&shmtable.lock);
+      if(s->npages < n)
+        return -1;
+      return s - shmtable.seg;
+    }
+  }
+  if((s = free) == 0){
+    release(&shmtable.lock);
+    return -1;
+  }
+
+  // Claim the slot, then allocate without the lock;
+  // kzalloc() may have to zero the pages.
+  s->key = key;
+  s->ref = 0;
+  s->npages = n;
+  s->creating = 1;
+  release(&shmtable.lock);
+  for(i = 0; i < n; i++)
+    if((pages[i] = kzalloc()) == 0)
+      break;
+
+  acquire(&shmtable.lock);
+  if(i < n)
+    s->npages = 0;
+  else
+    memmove(s->pages, pages, sizeof(pages[0]) * n);
+  s->creating = 0;
+  wakeup(s);
+  release(&shmtable.lock);
+  if(i < n){
+    freepages(pages, i);
+    return -1;
+  }
+  return s - shmtable.seg;
+}
+
+// Destroy s, which no region is attached to.
+// Caller must hold shmtable.lock; it is released.
+static void
+shmfree(struct shmseg *s)
+{
+  char *pages[SHMMAXPAGES];
+  int n;
+
+  n = s->npages;
+  memmove(pages, s->pages, sizeof(pages[0]) * n);
+  s->npages = 0;
+  release(&shmtable.lock);
+  freepages(pages, n);
+}
+
+// Remove segment id: shmget() no longer finds its key, and
+// it is destroyed now, or when the last region attached to
+// it goes away.
+int
+shmrm(int id)
+{
+  struct shmseg *s;
+
+  if(id < 0 || id >= NSHM)
+    return -1;
+  s = &shmtable.seg[id];
+  acquire(&shmtable.lock);
+  if(s->npages == 0 || s->creating || s->key == 0){
+    release(&shmtable.lock);
+    return -1;
+  }
+  s->key = 0;
+  if(s->ref > 0){
+    release(&shmtable.lock);
+    return 0;
+  }
+  shmfree(s);
+  return 0;
+}
+
+// Map segment id into the current process.
+// Returns the address of the region, or -1.
+int
+shmat(int id)
+{
+  struct shmseg *s;
+  struct vma *v;
+  uint len;
+
+  if(id < 0 || id >= NSHM)
+    return -1;
+  s = &shmtable.seg[id];
+  acquire(&shmtable.lock);
+  if(s->npages == 0 || s->creating){
+    release(&shmtable.lock);
+    return -1;
+  }
+  s->ref++;
+  len = s->npages * PGSIZE;
+  release(&shmtable.lock);
+
+  if((v = vmaalloc(myproc(), len)) == 0){
+    shmput(s);
+    return -1;
+  }
+  v->prot = PROT_READ|PROT_WRITE;
+  v->flags = MAP_SHARED;
+  v->shm = s;
+  return v->start;
+}
+
+// Detach the segment mapped at addr from the current process.
+int
+shmdt(uint addr)
+{
+  struct vma *v;
+
+  if((v = findvma(myproc(), addr)) == 0 || v->shm == 0 || v->start != addr)
+    return -1;
+  vmaunmap(myproc(), v);
+  return 0;
+}
+
+// Return page i of s with a reference for the caller.
+char*
+shmpage(struct shmseg *s, uint i)
+{
+  if(i >= s->npages)
+    return 0;
+  kincref(s->pages[i]);
+  return s->pages[i];
+}
+
+// Add a region attached to s, for fork().
+void
+shmdup(struct shmseg *s)
+{
+  acquire(&shmtable.lock);
+  s->ref++;
+  release(&shmtable.lock);
+}
+
+// Drop a region attached to s, destroying s with the last one.
+void
+shmput(struct shmseg *s)
+{
+  acquire(&shmtable.lock);
+  if(--s->ref > 0){
+    release(&shmtable.lock);
+    return;
+  }
+  shmfree(s);
+}
@@ -0,0 +1,52 @@
+// Exercise shared memory segment lookup and removal: shmget()
+// finds an existing key, shmrm() frees segments that were never
+// attached, so fresh keys do not run out, and a removed segment
+// lives until its last detach.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NKEY 100   // more than the kernel's segment table holds
+
+void
+fail(char *what)
+{
+  printf(1, "shmTest: %s\n", what);
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, id, id2;
+  char *p;
+
+  for(i = 0; i < NKEY; i++){
+    if((id = shmget(5000+i, 8192)) < 0)
+      fail("shmget of a fresh key");
+    if(shmget(5000+i, 4096) != id)
+      fail("shmget of an existing key");
+    if(shmrm(id) < 0)
+      fail("shmrm");
+  }
+
+  id = shmget(5000, 4096);
+  if(id < 0 || (p = shmat(id)) == (char*)-1)
+    fail("shmat");
+  p[0] = 'x';
+  if(shmrm(id) < 0 || shmrm(id) != -1)
+    fail("shmrm of an attached segment");
+  if((id2 = shmget(5000, 4096)) < 0 || id2 == id)
+    fail("removed key still found");
+  if(p[0] != 'x')
+    fail("removed segment lost while attached");
+  shmdt(p);
+  if((p = shmat(id2)) == (char*)-1 || p[0] != 0)
+    fail("new segment not zeroed");
+  shmdt(p);
+  if(shmat(id) != (char*)-1)
+    fail("destroyed segment still attachable");
+  printf(1, "shmTest ok\n");
+  exit();
+}
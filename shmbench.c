@@ -0,0 +1,99 @@
+// Compare bulk transfer between two processes through a pipe
+// and through a shared memory ring buffer.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define TOTAL  (1024*1024)  // bytes to transfer
+#define CHUNK  4096
+#define RING   (16*CHUNK)
+#define KEY    1032
+
+struct ring {
+  volatile uint head;  // bytes produced
+  volatile uint tail;  // bytes consumed
+  char pad[CHUNK - 2*sizeof(uint)];
+  char data[RING];
+};
+
+char buf[CHUNK];
+
+void
+report(char *how, uint ticks)
+{
+  if(ticks == 0)
+    ticks = 1;
+  printf(1, "%s: %d KB in %d ticks, %d KB/tick\n",
+         how, TOTAL/1024, ticks, TOTAL/1024/ticks);
+}
+
+void
+pipebench(void)
+{
+  int fds[2], n, tot;
+  uint t0;
+
+  if(pipe(fds) < 0){
+    printf(1, "pipe failed\n");
+    exit();
+  }
+  t0 = uptime();
+  if(fork() == 0){
+    close(fds[0]);
+    for(tot = 0; tot < TOTAL; tot += CHUNK)
+      write(fds[1], buf, CHUNK);
+    exit();
+  }
+  close(fds[1]);
+  for(tot = 0; tot < TOTAL; tot += n)
+    if((n = read(fds[0], buf, CHUNK)) <= 0)
+      break;
+  close(fds[0]);
+  wait(0, 0, 0);
+  report("pipe", uptime() - t0);
+}
+
+void
+shmbench(void)
+{
+  struct ring *r;
+  int id;
+  uint t0;
+
+  if((id = shmget(KEY, sizeof(struct ring))) < 0 ||
+     (r = (struct ring*)shmat(id)) == (struct ring*)-1){
+    printf(1, "shmget/shmat failed\n");
+    exit();
+  }
+  t0 = uptime();
+  if(fork() == 0){
+    // The child inherits the attached segment.
+    while(r->head < TOTAL){
+      while(r->head - r->tail >= RING)
+        ;
+      memmove(r->data + r->head % RING, buf, CHUNK);
+      __sync_synchronize();
+      r->head += CHUNK;
+    }
+    exit();
+  }
+  while(r->tail < TOTAL){
+    while(r->tail == r->head)
+      ;
+    memmove(buf, r->data + r->tail % RING, CHUNK);
+    __sync_synchronize();
+    r->tail += CHUNK;
+  }
+  wait(0, 0, 0);
+  report("shm", uptime() - t0);
+  shmdt(r);
+}
+
+int
+main(int argc, char *argv[])
+{
+  pipebench();
+  shmbench();
+  exit();
+}
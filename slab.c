@@ -0,0 +1,175 @@
+// Slab allocator for small kernel objects.
+//
+// Each kmemcache hands out objects of one size, carved out of
+// whole pages from kalloc().  A slab page starts with a struct
+// slab header followed by as many objects as fit, so kmcfree()
+// finds an object's slab by rounding its address down to the page.
+//
+// Allocation and free first try a small per-CPU stack of
+// objects, which needs only pushcli() instead of the cache lock;
+// the slab lists are used when that stack is empty or full.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "slab.h"
+
+struct slab {
+  struct kmemcache *cache;
+  struct slab *next;   // partial list
+  struct slab *prev;
+  void *freelist;      // free objects in this slab, linked through their first word
+  uint inuse;          // objects handed out
+};
+
+#define SLABHDR  ((sizeof(struct slab) + 7) & ~7)
+
+void
+kmcacheinit(struct kmemcache *c, char *name, uint size)
+{
+  int i;
+
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = (size + 7) & ~7;
+  if(c->size < sizeof(void*))
+    c->size = sizeof(void*);
+  if(SLABHDR + c->size > PGSIZE)
+    panic("kmcacheinit: object too big");
+  c->perslab = (PGSIZE - SLABHDR) / c->size;
+  c->partial = 0;
+  c->empty = 0;
+  for(i = 0; i < NCPU; i++)
+    c->cpu[i].n = 0;
+}
+
+static void
+partialadd(struct kmemcache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->partial;
+  if(c->partial)
+    c->partial->prev = s;
+  c->partial = s;
+}
+
+static void
+partialdel(struct kmemcache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+// Make a new slab out of a fresh page.
+static struct slab*
+slabnew(struct kmemcache *c)
+{
+  struct slab *s;
+  char *obj;
+  uint i;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return 0;
+  s->cache = c;
+  s->inuse = 0;
+  s->freelist = 0;
+  obj = (char*)s + SLABHDR;
+  for(i = 0; i < c->perslab; i++, obj += c->size){
+    *(void**)obj = s->freelist;
+    s->freelist = obj;
+  }
+  return s;
+}
+
+// Take one object from the slab lists.  Caller holds c->lock.
+static void*
+slaballoc(struct kmemcache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  if((s = c->partial) == 0){
+    if((s = c->empty) != 0)
+      c->empty = 0;
+    else if((s = slabnew(c)) == 0)
+      return 0;
+    partialadd(c, s);
+  }
+  obj = s->freelist;
+  s->freelist = *(void**)obj;
+  s->inuse++;
+  if(s->freelist == 0)
+    partialdel(c, s);
+  return obj;
+}
+
+// Return one object to its slab.  Caller holds c->lock.
+static void
+slabfree(struct kmemcache *c, void *obj)
+{
+  struct slab *s;
+
+  s = (struct slab*)PGROUNDDOWN((uint)obj);
+  if(s->cache != c)
+    panic("kmcfree: wrong cache");
+  if(s->freelist == 0)
+    partialadd(c, s);  // was full
+  *(void**)obj = s->freelist;
+  s->freelist = obj;
+  if(--s->inuse == 0){
+    // Keep one empty slab around; give further ones back.
+    partialdel(c, s);
+    if(c->empty == 0)
+      c->empty = s;
+    else
+      kfree((char*)s);
+  }
+}
+
+// Allocate an object from c.  Returns 0 if out of memory.
+// The object's contents are undefined.
+void*
+kmcalloc(struct kmemcache *c)
+{
+  void *obj;
+  int id;
+
+  pushcli();
+  id = cpuid();
+  if(c->cpu[id].n > 0){
+    obj = c->cpu[id].obj[--c->cpu[id].n];
+    popcli();
+    return obj;
+  }
+  popcli();
+
+  acquire(&c->lock);
+  obj = slaballoc(c);
+  release(&c->lock);
+  return obj;
+}
+
+// Free an object that kmcalloc(c) returned.
+void
+kmcfree(struct kmemcache *c, void *obj)
+{
+  int id, i;
+
+  pushcli();
+  id = cpuid();
+  if(c->cpu[id].n == NOBJCACHE){
+    // Full: hand half of them back to the slabs.
+    acquire(&c->lock);
+    for(i = 0; i < NOBJCACHE/2; i++)
+      slabfree(c, c->cpu[id].obj[--c->cpu[id].n]);
+    release(&c->lock);
+  }
+  c->cpu[id].obj[c->cpu[id].n++] = obj;
+  popcli();
+}
@@ -0,0 +1,22 @@
+// Object caches for small, fixed-size kernel objects.
+// See slab.c.
+
+#define NOBJCACHE 16  // objects kept per CPU by each cache
+
+struct slab;
+
+struct kmemcache {
+  struct spinlock lock;
+  char *name;        // for debugging
+  uint size;         // object size, rounded up to 8 bytes
+  uint perslab;      // objects per slab page
+  struct slab *partial;  // slabs with at least one free object
+  struct slab *empty;    // one slab with no objects in use, kept for reuse
+
+  // Per-CPU stacks of free objects.  Only touched by their
+  // own CPU with interrupts off, so they need no lock.
+  struct {
+    int n;
+    void *obj[NOBJCACHE];
+  } cpu[NCPU];
+};
@@ -0,0 +1,73 @@
+// Command launch latency the way sh runs a simple command:
+// fork+exec+wait, as it used to, against spawn+wait, which
+// it does now.  An argument grows the parent by that many KB
+// first, since fork() copies the parent and spawn() does not.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+
+#define N 200
+
+char *xargv[] = { "spawnbench", "-x", 0 };
+
+uint
+forkexec(void)
+{
+  uint t0;
+  int i, pid;
+
+  t0 = rdtsc();
+  for(i = 0; i < N; i++){
+    if((pid = fork()) < 0){
+      printf(1, "fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      exec(xargv[0], xargv);
+      printf(1, "exec %s failed\n", xargv[0]);
+      exit();
+    }
+    wait(0, 0, 0);
+  }
+  return (rdtsc() - t0) / N;
+}
+
+uint
+spawnwait(void)
+{
+  uint t0;
+  int i;
+
+  t0 = rdtsc();
+  for(i = 0; i < N; i++){
+    if(spawn(xargv[0], xargv, 0) < 0){
+      printf(1, "spawn %s failed\n", xargv[0]);
+      exit();
+    }
+    wait(0, 0, 0);
+  }
+  return (rdtsc() - t0) / N;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int kb;
+
+  if(argc > 1 && strcmp(argv[1], "-x") == 0)
+    exit();
+
+  kb = 0;
+  if(argc > 1)
+    kb = atoi(argv[1]);
+  if(kb > 0 && sbrk(kb * 1024) == (char*)-1){
+    printf(1, "sbrk failed\n");
+    exit();
+  }
+  printf(1, "parent grown by %d KB\n", kb);
+  printf(1, "fork+exec+wait: %d cycles\n", forkexec());
+  printf(1, "spawn+wait: %d cycles\n", spawnwait());
+  exit();
+}
@@ -0,0 +1,260 @@
+// Swapping user pages to disk.
+//
+// The swap area is SWAPSIZE blocks of disk SWAPDEV starting
+// at SWAPSTART, divided into page-sized slots.  When memory
+// runs low, reclaim() has evictpage() pick cold pages with
+// the clock algorithm and writes them out.  A swapped-out
+// page's PTE is not present but has PTE_SWAP set and holds
+// the slot number; touching the page faults, and swapfault()
+// reads it back in.
+//
+// Only pages below a process's sz are swapped: mmap() regions
+// have their own backing, and kernel memory is never swapped.
+// Swap I/O goes straight to the disk driver, not through the
+// buffer cache.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "kstat.h"
+
+#define BPP       (PGSIZE/BSIZE)     // blocks per slot
+#define NSLOT     (SWAPSIZE/BPP)
+#define RESERVE   32                 // free pages left for the kernel
+
+// Slot states.
+#define SLOTUSED  0x1  // holds a page
+#define SLOTBUSY  0x2  // being written
+
+struct {
+  struct spinlock lock;
+  uchar map[NSLOT];
+  int nslot;
+  int next;          // where to look for a free slot
+  uint nfree;
+  uint nout;
+  uint nin;
+} swap;
+
+void
+swapinit(void)
+{
+  initlock(&swap.lock, "swap");
+  swap.nslot = ideswapsize() / BPP;
+  if(swap.nslot > NSLOT)
+    swap.nslot = NSLOT;
+  swap.nfree = swap.nslot;
+}
+
+// Allocate a slot, marked busy until swapdone().
+// Returns -1 if the swap area is full.
+static int
+swapalloc(void)
+{
+  int i, slot;
+
+  acquire(&swap.lock);
+  for(i = 0; i < swap.nslot; i++){
+    slot = (swap.next + i) % swap.nslot;
+    if(swap.map[slot] == 0){
+      swap.map[slot] = SLOTUSED|SLOTBUSY;
+      swap.next = slot + 1;
+      swap.nfree--;
+      release(&swap.lock);
+      return slot;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+// Clear state bits of slot.  Readers wait for SLOTBUSY to
+// clear, so only then are they woken; freeing a slot wakes
+// no one, which lets it happen under ptable.lock, as when
+// wait() or the scheduler frees a page table.
+static void
+swapclear(uint slot, int state)
+{
+  if(slot >= swap.nslot)
+    panic("swapclear");
+  acquire(&swap.lock);
+  swap.map[slot] &= ~state;
+  if(swap.map[slot] == 0)
+    swap.nfree++;
+  if(state & SLOTBUSY)
+    wakeup(&swap.map[slot]);
+  release(&swap.lock);
+}
+
+// Free a slot whose page is no longer needed.  If it is
+// still being written, the slot is reused once it is done.
+// Does not sleep or take ptable.lock.
+void
+swapfree(uint slot)
+{
+  swapclear(slot, SLOTUSED);
+}
+
+// Copy the page at physical address pa to or from slot,
+// a block at a time.
+static void
+swaprw(uint slot, uint pa, int write)
+{
+  struct buf b;
+  char *v;
+  int i;
+
+  memset(&b, 0, sizeof(b));
+  initsleeplock(&b.lock, "swap");
+  acquiresleep(&b.lock);
+  b.dev = SWAPDEV;
+  for(i = 0; i < BPP; i++){
+    b.blockno = SWAPSTART + slot*BPP + i;
+    if(write){
+      v = tmpmap(pa);
+      memmove(b.data, v + i*BSIZE, BSIZE);
+      tmpunmap(v);
+      b.flags = B_DIRTY;
+    } else
+      b.flags = 0;
+    iderw(&b);
+    if(!write){
+      v = tmpmap(pa);
+      memmove(v + i*BSIZE, b.data, BSIZE);
+      tmpunmap(v);
+    }
+  }
+  releasesleep(&b.lock);
+}
+
+// Read the page in slot into the page at physical address
+// pa, after waiting for it to be written if need be.
+void
+swapread(uint slot, uint pa)
+{
+  acquire(&swap.lock);
+  while(swap.map[slot] & SLOTBUSY)
+    sleep(&swap.map[slot], &swap.lock);
+  release(&swap.lock);
+  swaprw(slot, pa, 0);
+}
+
+// Write one cold user page to swap and free it.
+// Returns 0, or -1 if there is no slot or no page to evict.
+static int
+swapout(void)
+{
+  pde_t *pgdir;
+  uint pa;
+  int slot;
+
+  if((slot = swapalloc()) < 0)
+    return -1;
+  if((pgdir = evictpage(slot, &pa)) == 0){
+    swapclear(slot, SLOTUSED|SLOTBUSY);
+    return -1;
+  }
+  swaprw(slot, pa, 1);
+  swapclear(slot, SLOTBUSY);
+  ufree(pa);
+  freevm(pgdir);
+  acquire(&swap.lock);
+  swap.nout++;
+  release(&swap.lock);
+  return 0;
+}
+
+// Swap out cold pages until npages user pages, plus a reserve
+// for the kernel's own allocations, are free.  Gives up at
+// once if swapping could not free enough.  May sleep, so the
+// caller must not hold a spinlock.
+void
+reclaim(int npages)
+{
+  struct kmemstat st;
+  uint nfree;
+
+  if(swap.nslot == 0)
+    return;
+  for(;;){
+    kmemstat(&st);
+    nfree = st.nfreepages + st.nfreehigh;
+    if(nfree >= npages + RESERVE || nfree + st.nfreeswap < npages + RESERVE)
+      return;
+    if(swapout() < 0)
+      return;
+  }
+}
+
+// Bring p's swapped-out page at va back in.  Returns 0 if
+// the access can be retried, or -1 if va is not swapped out
+// or there is no memory for it.
+int
+swapfault(struct proc *p, uint va)
+{
+  pte_t *pte, old;
+  uint pa;
+
+  va = PGROUNDDOWN(va);
+  if(va >= p->sz || (pte = walkpgdir(p->pgdir, (char*)va, 0)) == 0)
+    return -1;
+  old = *pte;
+  if((old & PTE_SWAP) == 0)
+    return -1;
+  reclaim(1);
+  if((pa = ualloc()) == 0){
+    cprintf("swapfault: out of memory\n");
+    return -1;
+  }
+  swapread(PTE_SLOT(old), pa);
+  // Another thread may have brought the page in, or freed
+  // it with sbrk(), while we slept.
+  if(cmpxchg(pte, old, pa | (PTE_FLAGS(old) & ~PTE_SWAP) | PTE_P) != old){
+    ufree(pa);
+    return 0;
+  }
+  swapfree(PTE_SLOT(old));
+  acquire(&swap.lock);
+  swap.nin++;
+  release(&swap.lock);
+  return 0;
+}
+
+// Bring in any swapped-out pages of [addr, addr+n) in the
+// current process, so that a system call can use them while
+// holding a lock.  Pages are not swapped out during a system
+// call, so they stay.
+int
+swapcheck(uint addr, uint n)
+{
+  struct proc *curproc = myproc();
+  pte_t *pte;
+  uint a;
+
+  for(a = PGROUNDDOWN(addr); a < addr + n; a += PGSIZE){
+    pte = walkpgdir(curproc->pgdir, (char*)a, 0);
+    if(pte && (*pte & PTE_SWAP) && swapfault(curproc, a) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+// Fill in the swap part of the memory statistics.
+void
+swapstat(struct kmemstat *st)
+{
+  acquire(&swap.lock);
+  st->nswapslots = swap.nslot;
+  st->nfreeswap = swap.nfree;
+  st->nswapout = swap.nout;
+  st->nswapin = swap.nin;
+  release(&swap.lock);
+}
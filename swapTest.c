@@ -0,0 +1,98 @@
+// Oversubscribe memory: several children together allocate
+// more than is free, so that pages of the ones not running
+// have to go to swap, and each checks that all its pages
+// read back.  Half the children then give their memory back
+// with sbrk() and the rest exit holding it, so swapped-out
+// pages are freed both ways; once all are reaped, their swap
+// slots must be free again.  Quicker with little memory: make
+// qemu MEMSIZE=64.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "kstat.h"
+
+#define PGSIZE 4096
+#define NCHILD 4
+#define EXTRA  1024  // pages beyond what is free
+#define CHUNK  64    // pages per sbrk()
+#define NPASS  3
+#define OTHERS 128   // pages of other processes that may stay in swap
+
+void
+fail(char *what)
+{
+  printf(1, "swapTest: %s\n", what);
+  exit();
+}
+
+void
+printstat(char *when)
+{
+  struct kmemstat st;
+
+  if(kmemstat(&st) < 0)
+    fail("kmemstat");
+  printf(1, "%s: %d pages free, %d of %d swap slots free, "
+         "%d out, %d in\n", when, st.nfreepages + st.nfreehigh,
+         st.nfreeswap, st.nswapslots, st.nswapout, st.nswapin);
+}
+
+// Grow by n pages a chunk at a time, so that most of the
+// time goes to touching memory rather than in sbrk().
+void
+child(int id, int n)
+{
+  char *mem;
+  int i, j, m, pass;
+
+  mem = sbrk(0);
+  for(i = 0; i < n; i += CHUNK){
+    m = n - i < CHUNK ? n - i : CHUNK;
+    if(sbrk(m * PGSIZE) == (char*)-1)
+      fail("sbrk");
+    for(j = 0; j < m; j++)
+      *(int*)(mem + (i+j)*PGSIZE) = id*n + i + j;
+  }
+  for(pass = 0; pass < NPASS; pass++)
+    for(i = 0; i < n; i++)
+      if(*(int*)(mem + i*PGSIZE) != id*n + i)
+        fail("page lost");
+  if(id % 2 && sbrk(-n * PGSIZE) == (char*)-1)
+    fail("sbrk shrink");
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct kmemstat st;
+  int i, n, pid;
+  uint nfree;
+
+  if(kmemstat(&st) < 0)
+    fail("kmemstat");
+  if(st.nswapslots == 0)
+    fail("no swap area");
+  n = st.nfreepages + st.nfreehigh + EXTRA;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  n /= NCHILD;
+  nfree = st.nfreeswap;
+  printstat("before");
+  for(i = 0; i < NCHILD; i++){
+    if((pid = fork()) < 0)
+      fail("fork");
+    if(pid == 0)
+      child(i, n);
+  }
+  for(i = 0; i < NCHILD; i++)
+    wait(0, 0, 0);
+  printstat("after");
+  if(kmemstat(&st) < 0)
+    fail("kmemstat");
+  if(st.nfreeswap + OTHERS < nfree)
+    fail("swap slots not freed");
+  printf(1, "swapTest done: %d children of %d pages\n", NCHILD, n);
+  exit();
+}
@@ -7,13 +7,18 @@
 #include "proc.h"
 #include "x86.h"
 #include "syscall.h"
+#include "traps.h"
 #include "stddef.h"
+#include "sysring.h"
 
-// User code makes a system call with INT T_SYSCALL.
+// User code makes a system call with sysenter or INT T_SYSCALL.
 // System call number in %eax.
-// Arguments on the stack, from the user call to the C
-// library system call function. The saved user %esp points
-// to a saved program counter, and then the first argument.
+// With INT T_SYSCALL, arguments on the stack, from the user
+// call to the C library system call function. The saved user
+// %esp points to a saved program counter, and then the first
+// argument.  The usys.S stubs use sysenter, and pass the first
+// SYSREGS arguments in %ebx, %esi, %edi and %ebp; the rest are
+// on the stack above the SYSREGS registers the stub saved.
 
 // Fetch the int at addr from the current process.
 int
@@ -21,7 +26,7 @@ fetchint(uint addr, int *ip)
 {
   struct proc *curproc = myproc();
 
-  if(addr >= curproc->sz || addr+4 > curproc->sz)
+  if((addr >= curproc->sz || addr+4 > curproc->sz) && vmacheck(addr, 4, 0) < 0)
     return -1;
   *ip = *(int*)(addr);
   return 0;
@@ -35,11 +40,15 @@ fetchstr(uint addr, char **pp)
 {
   char *s, *ep;
   struct proc *curproc = myproc();
+  struct vma *v;
 
-  if(addr >= curproc->sz)
+  if(addr < curproc->sz)
+    ep = (char*)curproc->sz;
+  else if((v = findvma(curproc, addr)) != 0)
+    ep = (char*)v->end;  // pages fault in as the loop reads them
+  else
     return -1;
   *pp = (char*)addr;
-  ep = (char*)curproc->sz;
   for(s = *pp; s < ep; s++){
     if(*s == 0)
       return s - *pp;
@@ -51,21 +60,38 @@ fetchstr(uint addr, char **pp)
 int
 argint(int n, int *ip)
 {
-  return fetchint((myproc()->tf->esp) + 4 + 4*n, ip);
+  struct trapframe *tf = myproc()->tf;
+
+  if(tf->trapno != T_SYSENTER)
+    return fetchint(tf->esp + 4 + 4*n, ip);
+  switch(n){
+  case 0: *ip = tf->ebx; return 0;
+  case 1: *ip = tf->esi; return 0;
+  case 2: *ip = tf->edi; return 0;
+  case 3: *ip = tf->ebp; return 0;
+  }
+  return fetchint(tf->esp + 4*SYSREGS + 4 + 4*n, ip);
 }
 
 // Fetch the nth word-sized system call argument as a pointer
 // to a block of memory of size bytes.  Check that the pointer
-// lies within the process address space.
+// lies within the process address space: below sz, or in an
+// mmap() region, which must be writable if the system call
+// will write the block.  Pages not in memory are faulted in here.
 int
-argptr(int n, char **pp, int size)
+argptr(int n, char **pp, int size, int write)
 {
   int i;
   struct proc *curproc = myproc();
  
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  if(size < 0)
+    return -1;
+  if((uint)i >= curproc->sz || (uint)i+size > curproc->sz){
+    if(vmacheck(i, size, write) < 0)
+      return -1;
+  } else if(swapcheck(i, size) < 0)
     return -1;
   *pp = (char*)i;
   return 0;
@@ -73,8 +99,8 @@ argptr(int n, char **pp, int size)
 
 // Fetch the nth word-sized system call argument as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
-// (There is no shared writable memory, so the string can't change
-// between this check and being used by the kernel.)
+// (A MAP_SHARED region can change under the check, but then
+// only the process's own view of its string goes wrong.)
 int
 argstr(int n, char **pp)
 {
@@ -114,6 +140,22 @@ extern int sys_changePolicy(void);
 extern int sys_getPriorityOfPID(void);
 extern int sys_setQueqeNumber(void);
 extern int sys_changeMultiFlag(void);
+extern int sys_kmemstat(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
+extern int sys_shmget(void);
+extern int sys_shmat(void);
+extern int sys_shmdt(void);
+extern int sys_shmrm(void);
+extern int sys_clone(void);
+extern int sys_join(void);
+extern int sys_futex_wait(void);
+extern int sys_futex_wake(void);
+extern int sys_kswitchstat(void);
+extern int sys_spawn(void);
+extern int sys_sysbatch(void);
+extern int sys_kbufstat(void);
+extern int sys_kdiskstat(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -146,6 +188,22 @@ static int (*syscalls[])(void) = {
 [SYS_getPriorityOfPID] sys_getPriorityOfPID,
 [SYS_setQueqeNumber]   sys_setQueqeNumber,
 [SYS_changeMultiFlag]  sys_changeMultiFlag,
+[SYS_kmemstat]     sys_kmemstat,
+[SYS_mmap]         sys_mmap,
+[SYS_munmap]       sys_munmap,
+[SYS_shmget]       sys_shmget,
+[SYS_shmat]        sys_shmat,
+[SYS_shmdt]        sys_shmdt,
+[SYS_clone]        sys_clone,
+[SYS_join]         sys_join,
+[SYS_futex_wait]   sys_futex_wait,
+[SYS_futex_wake]   sys_futex_wake,
+[SYS_kswitchstat]  sys_kswitchstat,
+[SYS_spawn]  sys_spawn,
+[SYS_sysbatch]     sys_sysbatch,
+[SYS_kbufstat]     sys_kbufstat,
+[SYS_kdiskstat]    sys_kdiskstat,
+[SYS_shmrm]        sys_shmrm,
 }; 
 
 void
@@ -171,4 +229,51 @@ syscall(void)
   }
 }
 
+// The calls sysbatch() will run: ones that neither replace
+// nor end the process, nor need the trap frame.
+static char batchable[] = {
+[SYS_read]   1,
+[SYS_write]  1,
+[SYS_open]   1,
+[SYS_close]  1,
+[SYS_fstat]  1,
+[SYS_wait]   1,
+};
 
+// Run the calls queued in a struct sysring, writing each
+// result into its entry, in one trip into the kernel.
+// A call that is not batchable gets -1 and the rest still
+// run.  Returns the number of entries run, or -1.
+int
+sys_sysbatch(void)
+{
+  struct proc *curproc = myproc();
+  struct sysring *r;
+  struct sysent *e;
+  uint esp, trapno;
+  int n, num;
+
+  if(argptr(0, (void*)&r, sizeof(*r), 1) < 0)
+    return -1;
+  if(r->tail - r->head > NRING)
+    return -1;
+  // Each entry's arguments are in memory, laid out as on the
+  // stack for int $T_SYSCALL.
+  esp = curproc->tf->esp;
+  trapno = curproc->tf->trapno;
+  curproc->tf->trapno = T_SYSCALL;
+  for(n = 0; r->head != r->tail && !curproc->killed; n++){
+    e = &r->ent[r->head % NRING];
+    num = e->num;
+    if(num > 0 && num < NELEM(batchable) && batchable[num]){
+      curproc->numsyscall[num-1]++;
+      curproc->tf->esp = (uint)e;
+      e->ret = syscalls[num]();
+      curproc->tf->esp = esp;
+    } else
+      e->ret = -1;
+    r->head++;
+  }
+  curproc->tf->trapno = trapno;
+  return n;
+}
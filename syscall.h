@@ -1,3 +1,6 @@
+// System call arguments the usys.S stubs pass in registers.
+#define SYSREGS 4
+
 // System call numbers
 #define SYS_fork    1
 #define SYS_exit    2
@@ -29,5 +32,21 @@
 #define SYS_getPriorityOfPID 28
 #define SYS_setQueqeNumber 29
 #define SYS_changeMultiFlag 30
+#define SYS_kmemstat 31
+#define SYS_mmap   32
+#define SYS_munmap 33
+#define SYS_shmget 34
+#define SYS_shmat  35
+#define SYS_shmdt  36
+#define SYS_clone  37
+#define SYS_join   38
+#define SYS_futex_wait 39
+#define SYS_futex_wake 40
+#define SYS_kswitchstat 41
+#define SYS_spawn  42
+#define SYS_sysbatch 43
+#define SYS_kbufstat 44
+#define SYS_kdiskstat 45
+#define SYS_shmrm  46
 
 
@@ -0,0 +1,48 @@
+// Measure system call latency: getpid() in a tight loop through
+// the usys.S stub, which passes arguments in registers and
+// enters with sysenter, and through the int $T_SYSCALL gate.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "syscall.h"
+#include "traps.h"
+
+#define N 100000
+
+int
+intgetpid(void)
+{
+  int pid;
+
+  asm volatile("int %1" : "=a" (pid) : "i" (T_SYSCALL), "0" (SYS_getpid)
+               : "memory");
+  return pid;
+}
+
+int
+main(int argc, char *argv[])
+{
+  uint t0, t1;
+  int i, pid;
+
+  pid = getpid();
+  if(intgetpid() != pid){
+    printf(1, "syscallbench: getpid mismatch\n");
+    exit();
+  }
+
+  t0 = rdtsc();
+  for(i = 0; i < N; i++)
+    getpid();
+  t1 = rdtsc();
+  printf(1, "sysenter: %d cycles per getpid\n", (t1 - t0) / N);
+
+  t0 = rdtsc();
+  for(i = 0; i < N; i++)
+    intgetpid();
+  t1 = rdtsc();
+  printf(1, "int: %d cycles per getpid\n", (t1 - t0) / N);
+  exit();
+}
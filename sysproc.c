@@ -6,6 +6,7 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "kstat.h"
 
 int
 sys_fork(void)
@@ -13,6 +14,28 @@ sys_fork(void)
   return fork();
 }
 
+int
+sys_clone(void)
+{
+  int fcn, arg1, arg2;
+  char *stack;
+
+  if(argint(0, &fcn) < 0 || argint(1, &arg1) < 0 || argint(2, &arg2) < 0 ||
+     argptr(3, &stack, PGSIZE, 1) < 0)
+    return -1;
+  return clone(fcn, arg1, arg2, (uint)stack);
+}
+
+int
+sys_join(void)
+{
+  void **stack;
+
+  if(argptr(0, (void*)&stack, sizeof(*stack), 1) < 0)
+    return -1;
+  return join(stack);
+}
+
 int
 sys_exit(void)
 {
@@ -26,11 +49,11 @@ sys_wait(void)
 
 
   int *cpuBurst, *turnaround, *waiting;
-  if (argptr(0, (void*)&cpuBurst, sizeof(cpuBurst)) < 0)
+  if (argptr(0, (void*)&cpuBurst, sizeof(cpuBurst), 1) < 0)
     return -1;
-  if (argptr(1, (void*)&turnaround, sizeof(turnaround)) < 0)
+  if (argptr(1, (void*)&turnaround, sizeof(turnaround), 1) < 0)
     return -1;
-  if (argptr(2, (void*)&waiting, sizeof(waiting)) < 0)
+  if (argptr(2, (void*)&waiting, sizeof(waiting), 1) < 0)
     return -1;
   return wait(cpuBurst,turnaround,waiting);
 }
@@ -181,3 +204,112 @@ int sys_changeMultiFlag(void){
 
 }
 
+// Copy physical allocator statistics to user space.
+int
+sys_kmemstat(void)
+{
+  struct kmemstat *st;
+
+  if(argptr(0, (void*)&st, sizeof(*st), 1) < 0)
+    return -1;
+  kmemstat(st);
+  return 0;
+}
+
+// Copy context switch statistics to user space.
+int
+sys_kswitchstat(void)
+{
+  struct kswitchstat *st;
+
+  if(argptr(0, (void*)&st, sizeof(*st), 1) < 0)
+    return -1;
+  kswitchstat(st);
+  return 0;
+}
+
+// Copy buffer cache statistics to user space.
+int
+sys_kbufstat(void)
+{
+  struct kbufstat *st;
+
+  if(argptr(0, (void*)&st, sizeof(*st), 1) < 0)
+    return -1;
+  bstat(st);
+  return 0;
+}
+
+// Copy disk queue statistics to user space.
+int
+sys_kdiskstat(void)
+{
+  struct kdiskstat *st;
+
+  if(argptr(0, (void*)&st, sizeof(*st), 1) < 0)
+    return -1;
+  idestats(st);
+  return 0;
+}
+
+int
+sys_shmget(void)
+{
+  int key, size;
+
+  if(argint(0, &key) < 0 || argint(1, &size) < 0 || size <= 0)
+    return -1;
+  return shmget(key, size);
+}
+
+int
+sys_shmat(void)
+{
+  int id;
+
+  if(argint(0, &id) < 0)
+    return -1;
+  return shmat(id);
+}
+
+int
+sys_shmdt(void)
+{
+  int addr;
+
+  if(argint(0, &addr) < 0)
+    return -1;
+  return shmdt(addr);
+}
+
+int
+sys_shmrm(void)
+{
+  int id;
+
+  if(argint(0, &id) < 0)
+    return -1;
+  return shmrm(id);
+}
+
+int
+sys_futex_wait(void)
+{
+  char *addr;
+  int val;
+
+  if(argptr(0, &addr, sizeof(uint), 0) < 0 || argint(1, &val) < 0)
+    return -1;
+  return futexwait((uint)addr, val);
+}
+
+int
+sys_futex_wake(void)
+{
+  char *addr;
+  int n;
+
+  if(argptr(0, &addr, sizeof(uint), 0) < 0 || argint(1, &n) < 0)
+    return -1;
+  return futexwake((uint)addr, n);
+}
@@ -0,0 +1,22 @@
+// A ring of system calls for sysbatch().
+// Both the kernel and user programs use this header file.
+
+#define NRING 32
+
+// One queued call.  The arguments are laid out as they would
+// be on the stack after the return address, so the kernel runs
+// the call by pointing argint() at the entry.
+struct sysent {
+  int num;                   // SYS_ number
+  int arg[5];                // arguments
+  int ret;                   // result, written by sysbatch()
+};
+
+// User code fills ent[tail % NRING] and advances tail;
+// sysbatch() runs the entries from head up to tail in order
+// and advances head past each one it finishes.
+struct sysring {
+  uint head;
+  uint tail;
+  struct sysent ent[NRING];
+};
@@ -0,0 +1,75 @@
+// Split a CPU-bound loop across threads that share one
+// address space, and compare the time against one thread.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NTHREAD 8
+#define WORK    (1 << 24)
+
+lock_t lock;
+volatile uint total;
+
+void
+worker(void *arg1, void *arg2)
+{
+  int i, n;
+  uint sum;
+
+  n = (int)arg1;
+  sum = 0;
+  for(i = 0; i < n; i++)
+    sum += i & 7;
+  lock_acquire(&lock);
+  total += sum;
+  lock_release(&lock);
+  exit();
+}
+
+int
+run(int nthread)
+{
+  int i, m;
+  uint t0;
+
+  total = 0;
+  t0 = uptime();
+  for(i = 0; i < nthread; i++){
+    if(thread_create(worker, (void*)(WORK / nthread), 0) < 0){
+      printf(1, "thread_create failed\n");
+      exit();
+    }
+  }
+  for(i = 0; i < nthread; i++)
+    if(thread_join() < 0){
+      printf(1, "thread_join failed\n");
+      exit();
+    }
+  if(thread_join() != -1){
+    printf(1, "thread_join: too many threads\n");
+    exit();
+  }
+  m = WORK / nthread;
+  if(total != nthread * ((m / 8) * 28 + (m % 8) * (m % 8 - 1) / 2)){
+    printf(1, "wrong total %d\n", total);
+    exit();
+  }
+  return uptime() - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n;
+
+  lock_init(&lock);
+  printf(1, "1 thread: %d ticks\n", run(1));
+  n = NTHREAD;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n < 1 || n > NTHREAD)
+    n = NTHREAD;
+  printf(1, "%d threads: %d ticks\n", n, run(n));
+  exit();
+}
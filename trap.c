@@ -7,6 +7,7 @@
 #include "x86.h"
 #include "traps.h"
 #include "spinlock.h"
+#include "vdata.h"
 
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
@@ -14,6 +15,29 @@ extern uint vectors[];  // in vectors.S: array of 256 entry pointers
 struct spinlock tickslock;
 uint ticks;
 uint policy;
+
+// The page mapped read-only at VDATA in every address space.
+// It holds nothing else, since user programs can read it all.
+__attribute__((__aligned__(PGSIZE)))
+char vdatapage[PGSIZE];
+
+#define CALIBSTART 10   // tick at which to start timing the TSC
+#define CALIBTICKS 10   // ticks to time it over
+static uint calibtsc;
+
+// Publish the tick count, and measure rdtsc() cycles per
+// tick once the clock has settled.  Called with tickslock.
+static void
+vdatatick(void)
+{
+  struct vdata *vd = (struct vdata*)vdatapage;
+
+  vd->ticks = ticks;
+  if(ticks == CALIBSTART)
+    calibtsc = rdtsc();
+  else if(ticks == CALIBSTART + CALIBTICKS)
+    vd->tscpertick = (rdtsc() - calibtsc) / CALIBTICKS;
+}
 //void processingTimeVariables(void); ////
 void
 tvinit(void)
@@ -33,17 +57,69 @@ idtinit(void)
   lidt(idt, sizeof(idt));
 }
 
+// Handle a page fault on a user address.  mmap() regions are
+// filled on demand and swapped-out pages read back in, so a
+// fault on either is not an error.
+// Returns 0 if the faulting instruction can be restarted.
+static int
+pgfault(struct trapframe *tf)
+{
+  uint va = rcr2();
+
+  if(myproc() == 0 || va >= KERNBASE)
+    return -1;
+  // From the kernel, this is a system call using user memory.
+  // Filling the page may sleep, which it must not do while
+  // holding a spinlock.
+  if((tf->cs&3) != DPL_USER && mycpu()->ncli > 0)
+    return -1;
+  if(swapfault(myproc(), va) == 0)
+    return 0;
+  return vmafault(myproc(), va, tf->err & FEC_WR);
+}
+
+// Is tf an invalid opcode trap on a sysenter in a usys.S stub,
+// from a CPU that does not have the instruction?
+static int
+issysenter(struct trapframe *tf)
+{
+  struct proc *p = myproc();
+
+  if(p == 0 || (tf->cs&3) != DPL_USER || tf->eip + 2 > p->sz)
+    return 0;
+  return *(ushort*)tf->eip == 0x340F;
+}
+
+// Run the system call in tf.  sysentry in trapasm.S calls
+// this directly, skipping trap().
+void
+systrap(struct trapframe *tf)
+{
+  if(myproc()->killed)
+    exit();
+  myproc()->tf = tf;
+  myproc()->insyscall = 1;
+  syscall();
+  myproc()->insyscall = 0;
+  if(myproc()->killed)
+    exit();
+}
+
 //PAGEBREAK: 41
 void
 trap(struct trapframe *tf)
 {
-  if(tf->trapno == T_SYSCALL){
-    if(myproc()->killed)
-      exit();
-    myproc()->tf = tf;
-    syscall();
-    if(myproc()->killed)
-      exit();
+  if(tf->trapno == T_ILLOP && issysenter(tf)){
+    // Finish the system call as sysentry would, with the
+    // arguments in registers, returning where sysexit would.
+    tf->trapno = T_SYSENTER;
+    tf->eip = tf->edx;
+    tf->esp = tf->ecx;
+    sti();
+  }
+
+  if(tf->trapno == T_SYSCALL || tf->trapno == T_SYSENTER){
+    systrap(tf);
     return;
   }
 
@@ -53,6 +129,7 @@ trap(struct trapframe *tf)
       acquire(&tickslock);
       processingTimeVariables();
       ticks++;
+      vdatatick();
       wakeup(&ticks);
       release(&tickslock);
       
@@ -80,6 +157,10 @@ trap(struct trapframe *tf)
             cpuid(), tf->cs, tf->eip);
     lapiceoi();
     break;
+  case T_PGFLT:
+    if(pgfault(tf) == 0)
+      break;
+    // Not in a region: fall through to kill the process.
 
   //PAGEBREAK: 13
   default:
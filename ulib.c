@@ -3,6 +3,9 @@
 #include "fcntl.h"
 #include "user.h"
 #include "x86.h"
+#include "memlayout.h"
+#include "vdata.h"
+#include "sysring.h"
 
 char*
 strcpy(char *s, const char *t)
@@ -104,3 +107,47 @@ memmove(void *vdst, const void *vsrc, int n)
     *dst++ = *src++;
   return vdst;
 }
+
+// uptime(), getpid() and getParentID() without a system call,
+// read from the pages the kernel maps at VDATA and UPROC.
+uint
+vuptime(void)
+{
+  return ((volatile struct vdata*)VDATA)->ticks;
+}
+
+int
+vgetpid(void)
+{
+  int pid = ((volatile struct vproc*)UPROC)->pid;
+
+  return pid > 0 ? pid : getpid();
+}
+
+int
+vgetppid(void)
+{
+  volatile struct vproc *vp = (struct vproc*)UPROC;
+
+  return vp->pid > 0 ? vp->ppid : getParentID();
+}
+
+// Queue the call num(a0, a1, a2) on r for sysbatch().
+// Returns its entry, where the result will be, or 0 if
+// the ring is full.
+struct sysent*
+sysqueue(struct sysring *r, int num, int a0, int a1, int a2)
+{
+  struct sysent *e;
+
+  if(r->tail - r->head >= NRING)
+    return 0;
+  e = &r->ent[r->tail % NRING];
+  e->num = num;
+  e->arg[0] = a0;
+  e->arg[1] = a1;
+  e->arg[2] = a2;
+  e->ret = -1;
+  r->tail++;
+  return e;
+}
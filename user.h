@@ -1,5 +1,11 @@
 struct stat;
 struct rtcdate;
+struct kmemstat;
+struct kswitchstat;
+struct kbufstat;
+struct kdiskstat;
+struct sysring;
+struct sysent;
 
 // system calls
 int fork(void);
@@ -32,6 +38,22 @@ int changePolicy(int);
 int getPriorityOfPID(int);
 int setQueqeNumber(int);
 int changeMultiFlag(int);
+int kmemstat(struct kmemstat*);
+int kswitchstat(struct kswitchstat*);
+int kbufstat(struct kbufstat*);
+int kdiskstat(struct kdiskstat*);
+int spawn(char*, char**, int*);
+int sysbatch(struct sysring*);
+char* mmap(void*, int, int, int, int, int);
+int munmap(void*, int);
+int shmget(int, int);
+char* shmat(int);
+int shmdt(void*);
+int shmrm(int);
+int clone(void(*)(void*, void*), void*, void*, void*);
+int join(void**);
+int futex_wait(volatile uint*, uint);
+int futex_wake(volatile uint*, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -46,3 +68,35 @@ void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+uint vuptime(void);
+int vgetpid(void);
+int vgetppid(void);
+struct sysent* sysqueue(struct sysring*, int, int, int, int);
+
+// uthread.c
+typedef struct {
+  volatile uint locked;
+} lock_t;
+
+int thread_create(void(*)(void*, void*), void*, void*);
+int thread_join(void);
+void lock_init(lock_t*);
+void lock_acquire(lock_t*);
+void lock_release(lock_t*);
+
+typedef struct {
+  volatile uint state;  // 0 unlocked, 1 locked, 2 locked with waiters
+} mutex_t;
+
+typedef struct {
+  volatile uint seq;      // bumped by every signal
+  volatile uint nwaiters;
+} cond_t;
+
+void mutex_init(mutex_t*);
+void mutex_lock(mutex_t*);
+void mutex_unlock(mutex_t*);
+void cond_init(cond_t*);
+void cond_wait(cond_t*, mutex_t*);
+void cond_signal(cond_t*);
+void cond_broadcast(cond_t*);
@@ -1590,6 +1590,48 @@ validatetest(void)
   printf(stdout, "validate ok\n");
 }
 
+// system calls must not write into a read-only mapping, and
+// must copy a private mapping's page before writing it.
+void
+mmaprwtest(void)
+{
+  int fd;
+  char *p;
+
+  printf(stdout, "mmap rw test\n");
+  fd = open("mmaprw", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, "hello", 5) != 5){
+    printf(stdout, "mmap rw: create mmaprw failed\n");
+    exit();
+  }
+  p = mmap(0, 4096, PROT_READ, MAP_SHARED, fd, 0);
+  if(p == (char*)-1){
+    printf(stdout, "mmap rw: mmap failed\n");
+    exit();
+  }
+  if(read(fd, p, 5) != -1){
+    printf(stdout, "mmap rw: read into PROT_READ mapping succeeded\n");
+    exit();
+  }
+  munmap(p, 4096);
+
+  p = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == (char*)-1){
+    printf(stdout, "mmap rw: mmap private failed\n");
+    exit();
+  }
+  close(fd);
+  fd = open("mmaprw", O_RDONLY);
+  if(fd < 0 || read(fd, p+1, 4) != 4 || p[0] != 'h' || p[1] != 'h'){
+    printf(stdout, "mmap rw: read into private mapping failed\n");
+    exit();
+  }
+  munmap(p, 4096);
+  close(fd);
+  unlink("mmaprw");
+  printf(stdout, "mmap rw ok\n");
+}
+
 // does unintialized data start out zero?
 char uninit[10000];
 void
@@ -1770,6 +1812,7 @@ main(int argc, char *argv[])
   bsstest();
   sbrktest();
   validatetest();
+  mmaprwtest();
 
   opentest();
   writetest();
@@ -0,0 +1,127 @@
+// User-level thread library: threads made by clone(), and
+// spin locks, mutexes and condition variables for them to
+// share data with.  Mutexes and condition variables only
+// make futex system calls when a thread has to wait.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+
+#define TSTACKSIZE 4096  // clone() takes a one-page stack
+
+// Run fcn(arg1, arg2) in a new thread sharing this address
+// space.  Returns the thread's pid, or -1.
+int
+thread_create(void (*fcn)(void*, void*), void *arg1, void *arg2)
+{
+  void *stack;
+  int pid;
+
+  if((stack = malloc(TSTACKSIZE)) == 0)
+    return -1;
+  if((pid = clone(fcn, arg1, arg2, stack)) < 0)
+    free(stack);
+  return pid;
+}
+
+// Wait for a thread to exit and free its stack.
+// Returns its pid, or -1 if there are no threads.
+int
+thread_join(void)
+{
+  void *stack;
+  int pid;
+
+  if((pid = join(&stack)) >= 0)
+    free(stack);
+  return pid;
+}
+
+void
+lock_init(lock_t *lk)
+{
+  lk->locked = 0;
+}
+
+void
+lock_acquire(lock_t *lk)
+{
+  while(xchg(&lk->locked, 1) != 0)
+    ;
+}
+
+void
+lock_release(lock_t *lk)
+{
+  xchg(&lk->locked, 0);
+}
+
+void
+mutex_init(mutex_t *m)
+{
+  m->state = 0;
+}
+
+// A mutex is 0 when unlocked, 1 when locked, and 2 when
+// locked with threads (maybe) sleeping in futex_wait().
+// See Drepper, "Futexes Are Tricky".
+void
+mutex_lock(mutex_t *m)
+{
+  uint c;
+
+  if((c = __sync_val_compare_and_swap(&m->state, 0, 1)) == 0)
+    return;
+  if(c != 2)
+    c = xchg(&m->state, 2);
+  while(c != 0){
+    futex_wait(&m->state, 2);
+    c = xchg(&m->state, 2);
+  }
+}
+
+void
+mutex_unlock(mutex_t *m)
+{
+  if(__sync_fetch_and_sub(&m->state, 1) != 1){
+    m->state = 0;
+    futex_wake(&m->state, 1);
+  }
+}
+
+void
+cond_init(cond_t *c)
+{
+  c->seq = 0;
+  c->nwaiters = 0;
+}
+
+void
+cond_wait(cond_t *c, mutex_t *m)
+{
+  uint seq;
+
+  seq = c->seq;
+  __sync_fetch_and_add(&c->nwaiters, 1);
+  mutex_unlock(m);
+  futex_wait(&c->seq, seq);
+  __sync_fetch_and_sub(&c->nwaiters, 1);
+  mutex_lock(m);
+}
+
+void
+cond_signal(cond_t *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  if(c->nwaiters)
+    futex_wake(&c->seq, 1);
+}
+
+void
+cond_broadcast(cond_t *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  if(c->nwaiters)
+    futex_wake(&c->seq, 0x7fffffff);  // all of them
+}
@@ -0,0 +1,16 @@
+// Kernel data that user programs read without a system call.
+// Both the kernel and user programs use this header file.
+
+// One page at VDATA, shared by every address space.
+struct vdata {
+  uint ticks;                // timer ticks since boot, as uptime()
+  uint tscpertick;           // rdtsc() cycles per tick, or 0 until measured
+};
+
+// One page at UPROC in each address space.  Threads made by
+// clone() share it, so it cannot tell them apart: pid is then
+// -1 and user code asks the kernel instead.
+struct vproc {
+  int pid;                   // as getpid()
+  int ppid;                  // as getParentID()
+};
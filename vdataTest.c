@@ -0,0 +1,82 @@
+// Check that vuptime(), vgetpid() and vgetppid() agree with
+// the system calls, in a child, in an orphan and in a thread,
+// and compare what a call of each kind costs.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "memlayout.h"
+#include "vdata.h"
+
+#define N 10000
+
+void
+fail(char *what)
+{
+  printf(1, "vdataTest: %s\n", what);
+  exit();
+}
+
+void
+check(char *who)
+{
+  if(vgetpid() != getpid())
+    fail(who);
+  if(vgetppid() != getParentID())
+    fail(who);
+}
+
+void
+thread(void *arg1, void *arg2)
+{
+  check("thread pid");
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct vdata *vd = (struct vdata*)VDATA;
+  int pid, i;
+  uint t0, t1, t;
+
+  check("pid");
+  t = vuptime();
+  if(t > uptime() || uptime() - t > 1)
+    fail("uptime");
+
+  if((pid = fork()) == 0){
+    check("child pid");
+    // Let the grandchild be orphaned and move to init.
+    if(fork() == 0){
+      sleep(10);
+      if(vgetppid() != 1)
+        fail("orphan ppid");
+      check("orphan pid");
+      exit();
+    }
+    exit();
+  }
+  wait(0, 0, 0);
+  sleep(20);
+
+  if(thread_create(thread, 0, 0) < 0)
+    fail("thread_create");
+  thread_join();
+  check("after thread");
+
+  t0 = rdtsc();
+  for(i = 0; i < N; i++)
+    uptime();
+  t1 = rdtsc();
+  printf(1, "uptime: %d cycles\n", (t1 - t0) / N);
+  t0 = rdtsc();
+  for(i = 0; i < N; i++)
+    vuptime();
+  t1 = rdtsc();
+  printf(1, "vuptime: %d cycles\n", (t1 - t0) / N);
+  printf(1, "%d TSC cycles per tick\n", vd->tscpertick);
+  printf(1, "vdataTest ok\n");
+  exit();
+}
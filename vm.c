@@ -6,9 +6,13 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "vdata.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
+extern char sysentry[];  // in trapasm.S
+extern char vdatapage[]; // in trap.c
+static int havesysenter; // CPUs have sysenter, set up by seginit()
 
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
@@ -26,13 +30,34 @@ seginit(void)
   c->gdt[SEG_KDATA] = SEG(STA_W, 0, 0xffffffff, 0);
   c->gdt[SEG_UCODE] = SEG(STA_X|STA_R, 0, 0xffffffff, DPL_USER);
   c->gdt[SEG_UDATA] = SEG(STA_W, 0, 0xffffffff, DPL_USER);
+
+  // The task state segment only tells the CPU which stack to
+  // use on a trap from user space, so load it once here;
+  // switchuvm() just updates esp0.
+  c->gdt[SEG_TSS] = SEG16(STS_T32A, &c->ts, sizeof(c->ts)-1, 0);
+  c->gdt[SEG_TSS].s = 0;
+  c->ts.ss0 = SEG_KDATA << 3;
+  // setting IOPL=0 in eflags *and* iomb beyond the tss segment limit
+  // forbids I/O instructions (e.g., inb and outb) from user space
+  c->ts.iomb = (ushort) 0xFFFF;
   lgdt(c->gdt, sizeof(c->gdt));
+  ltr(SEG_TSS << 3);
+
+  // System calls may also come in through sysenter, which
+  // starts sysentry in trapasm.S on the stack in
+  // MSR_SYSENTER_ESP; switchuvm() keeps that up to date.
+  if(cpufeatures() & CPUID_SEP){
+    havesysenter = 1;
+    wrmsr(MSR_SYSENTER_CS, SEG_KCODE << 3);
+    wrmsr(MSR_SYSENTER_ESP, 0);
+    wrmsr(MSR_SYSENTER_EIP, (uint)sysentry);
+  }
 }
 
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page table pages.
-static pte_t *
+pte_t*
 walkpgdir(pde_t *pgdir, const void *va, int alloc)
 {
   pde_t *pde;
@@ -42,10 +67,9 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
   if(*pde & PTE_P){
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else {
-    if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
+    // kzalloc makes sure all those PTE_P bits are zero.
+    if(!alloc || (pgtab = (pte_t*)kzalloc()) == 0)
       return 0;
-    // Make sure all those PTE_P bits are zero.
-    memset(pgtab, 0, PGSIZE);
     // The permissions here are overly generous, but they can
     // be further restricted by the permissions in the page table
     // entries, if necessary.
@@ -57,7 +81,7 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
 // be page-aligned.
-static int
+int
 mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 {
   char *a, *last;
@@ -79,6 +103,44 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
   return 0;
 }
 
+// Like mappages, but for the kernel's part of the address space:
+// each 4MB-aligned piece that the range covers completely is mapped
+// by a single PTE_PS directory entry instead of a page table.
+static int
+mapkpages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
+{
+  char *a, *last;
+  pde_t *pde;
+  pte_t *pte;
+
+  a = (char*)PGROUNDDOWN((uint)va);
+  last = (char*)PGROUNDDOWN(((uint)va) + size - 1);
+  for(;;){
+    if((uint)a % SUPERPGSIZE == 0 && pa % SUPERPGSIZE == 0 &&
+       (uint)(last - a) >= SUPERPGSIZE - PGSIZE){
+      pde = &pgdir[PDX(a)];
+      if(*pde & PTE_P)
+        panic("remap");
+      *pde = pa | perm | PTE_P | PTE_PS;
+      if((uint)(last - a) == SUPERPGSIZE - PGSIZE)
+        break;
+      a += SUPERPGSIZE;
+      pa += SUPERPGSIZE;
+      continue;
+    }
+    if((pte = walkpgdir(pgdir, a, 1)) == 0)
+      return -1;
+    if(*pte & PTE_P)
+      panic("remap");
+    *pte = pa | perm | PTE_P;
+    if(a == last)
+      break;
+    a += PGSIZE;
+    pa += PGSIZE;
+  }
+  return 0;
+}
+
 // There is one page table per process, plus one that's used when
 // a CPU is not running any process (kpgdir). The kernel uses the
 // current process's page table during system calls and interrupts;
@@ -88,17 +150,27 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 // setupkvm() and exec() set up every page table like this:
 //
 //   0..KERNBASE: user memory (text+data+stack+heap), mapped to
-//                phys memory allocated by the kernel
+//                phys memory allocated by the kernel; the last
+//                page, UPROC, is read-only and set up by exec()
 //   KERNBASE..KERNBASE+EXTMEM: mapped to 0..EXTMEM (for I/O space)
 //   KERNBASE+EXTMEM..data: mapped to EXTMEM..V2P(data)
 //                for the kernel's instructions and r/o data
-//   data..KERNBASE+PHYSTOP: mapped to V2P(data)..PHYSTOP,
+//   data..KERNBASE+phystop: mapped to V2P(data)..phystop,
 //                                  rw data + free physical memory
+//   TMPMAPBASE..TMPMAPBASE+4MB: temporary mappings of high memory,
+//                and the user-readable page VDATA at the end
 //   0xfe000000..0: mapped direct (devices such as ioapic)
 //
 // The kernel allocates physical memory for its heap and for user memory
-// between V2P(end) and the end of physical memory (PHYSTOP)
-// (directly addressable from end..P2V(PHYSTOP)).
+// between V2P(end) and phystop, the end of the physical memory it
+// maps directly (directly addressable from end..P2V(phystop)).
+// User pages may also come from memory above phystop; see highmem.c.
+//
+// kvmalloc() builds the kernel part once, in kpgdir, using 4MB
+// PTE_PS entries wherever the mapping allows (everything past the
+// first 4MB, which holds the read-only kernel text).  setupkvm()
+// copies kpgdir's kernel directory entries, so every page table
+// shares the same kernel page tables and superpage entries.
 
 // This table defines the kernel's mappings, which are present in
 // every process's page table.
@@ -110,7 +182,8 @@ static struct kmap {
 } kmap[] = {
  { (void*)KERNBASE, 0,             EXTMEM,    PTE_W}, // I/O space
  { (void*)KERNLINK, V2P(KERNLINK), V2P(data), 0},     // kern text+rodata
- { (void*)data,     V2P(data),     PHYSTOP,   PTE_W}, // kern data+memory
+ { (void*)data,     V2P(data),     0,         PTE_W}, // kern data+memory
+ { (void*)VDATA,    V2P(vdatapage), V2P(vdatapage)+PGSIZE, PTE_U}, // vdata
  { (void*)DEVSPACE, DEVSPACE,      0,         PTE_W}, // more devices
 };
 
@@ -119,28 +192,35 @@ pde_t*
 setupkvm(void)
 {
   pde_t *pgdir;
-  struct kmap *k;
 
+  // The user half starts empty and the kernel half is a copy
+  // of kpgdir's, so only zero the user half.
   if((pgdir = (pde_t*)kalloc()) == 0)
     return 0;
-  memset(pgdir, 0, PGSIZE);
-  if (P2V(PHYSTOP) > (void*)DEVSPACE)
-    panic("PHYSTOP too high");
-  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
-    if(mappages(pgdir, k->virt, k->phys_end - k->phys_start,
-                (uint)k->phys_start, k->perm) < 0) {
-      freevm(pgdir);
-      return 0;
-    }
+  memset(pgdir, 0, PDX(KERNBASE) * sizeof(pde_t));
+  memmove(&pgdir[PDX(KERNBASE)], &kpgdir[PDX(KERNBASE)],
+          (NPDENTRIES - PDX(KERNBASE)) * sizeof(pde_t));
   return pgdir;
 }
 
 // Allocate one page table for the machine for the kernel address
-// space for scheduler processes.
+// space for scheduler processes.  Its kernel mappings are the
+// ones every other page table shares.
 void
 kvmalloc(void)
 {
-  kpgdir = setupkvm();
+  struct kmap *k;
+
+  if (TMPMAPBASE + SUPERPGSIZE > DEVSPACE)
+    panic("DIRECTMAX too high");
+  if((kpgdir = (pde_t*)kzalloc()) == 0)
+    panic("kvmalloc");
+  kmap[2].phys_end = phystop;  // found by meminit()
+  tmpmapinit(kpgdir);
+  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
+    if(mapkpages(kpgdir, k->virt, k->phys_end - k->phys_start,
+                 (uint)k->phys_start, k->perm) < 0)
+      panic("kvmalloc");
   switchkvm();
 }
 
@@ -153,9 +233,21 @@ switchkvm(void)
 }
 
 // Switch TSS and h/w page table to correspond to process p.
+//
+// The scheduler does not switch back to kpgdir between
+// processes, so the page table is reloaded, flushing the
+// TLB, only when p's differs from the one already loaded:
+// running the same process or another thread of it again
+// keeps the TLB warm.  The CPU holds a kalloc() reference to
+// the page table it has loaded (see freevm()), so the table
+// cannot be freed under it after its process is reaped.
+// A page swapped out of the loaded table forces a reload too.
 void
 switchuvm(struct proc *p)
 {
+  struct cpu *c;
+  pde_t *old;
+
   if(p == 0)
     panic("switchuvm: no process");
   if(p->kstack == 0)
@@ -164,16 +256,43 @@ switchuvm(struct proc *p)
     panic("switchuvm: no pgdir");
 
   pushcli();
-  mycpu()->gdt[SEG_TSS] = SEG16(STS_T32A, &mycpu()->ts,
-                                sizeof(mycpu()->ts)-1, 0);
-  mycpu()->gdt[SEG_TSS].s = 0;
-  mycpu()->ts.ss0 = SEG_KDATA << 3;
-  mycpu()->ts.esp0 = (uint)p->kstack + KSTACKSIZE;
-  // setting IOPL=0 in eflags *and* iomb beyond the tss segment limit
-  // forbids I/O instructions (e.g., inb and outb) from user space
-  mycpu()->ts.iomb = (ushort) 0xFFFF;
-  ltr(SEG_TSS << 3);
-  lcr3(V2P(p->pgdir));  // switch to process's address space
+  c = mycpu();
+  c->ts.esp0 = (uint)p->kstack + KSTACKSIZE;
+  if(havesysenter)
+    wrmsr(MSR_SYSENTER_ESP, (uint)p->kstack + KSTACKSIZE);
+  if(c->pgdir != p->pgdir){
+    old = c->pgdir;
+    kincref((char*)p->pgdir);
+    lcr3(V2P(p->pgdir));  // switch to process's address space
+    c->pgdir = p->pgdir;
+    c->ncr3++;
+    if(old)
+      freevm(old);
+  } else if(c->tlbstale){
+    lcr3(V2P(p->pgdir));
+    c->ncr3++;
+  }
+  c->tlbstale = 0;
+  popcli();
+}
+
+// Called by the idle scheduler: if no process uses the page
+// table this CPU has loaded any more, switch to kpgdir and
+// free it, rather than keep an exited process's memory
+// until the CPU next runs something.
+void
+switchkvmidle(void)
+{
+  struct cpu *c;
+  pde_t *old;
+
+  pushcli();
+  c = mycpu();
+  if((old = c->pgdir) != 0 && krefcount((char*)old) == 1){
+    switchkvm();
+    c->pgdir = 0;
+    freevm(old);
+  }
   popcli();
 }
 
@@ -186,12 +305,77 @@ inituvm(pde_t *pgdir, char *init, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kzalloc();
   mappages(pgdir, 0, PGSIZE, V2P(mem), PTE_W|PTE_U);
   memmove(mem, init, sz);
 }
 
+// Allocate a zeroed page for user memory and return its
+// physical address, or 0.  User pages come from high memory
+// while there is any, leaving the directly mapped memory for
+// the kernel.
+uint
+ualloc(void)
+{
+  char *mem;
+  uint pa;
+
+  if((pa = highalloc()) != 0){
+    mem = tmpmap(pa);
+    memset(mem, 0, PGSIZE);
+    tmpunmap(mem);
+    return pa;
+  }
+  if((mem = kzalloc()) == 0)
+    return 0;
+  return V2P(mem);
+}
+
+// Free a user page, wherever it came from.
+void
+ufree(uint pa)
+{
+  if(pa >= phystop)
+    highfree(pa);
+  else
+    kfree(P2V(pa));
+}
+
+// Map a zeroed, read-only page at UPROC in pgdir for its
+// struct vproc.  Returns 0, or -1 if out of memory.
+int
+allocvproc(pde_t *pgdir)
+{
+  uint pa;
+
+  if((pa = ualloc()) == 0)
+    return -1;
+  if(mappages(pgdir, (char*)UPROC, PGSIZE, pa, PTE_U) < 0){
+    ufree(pa);
+    return -1;
+  }
+  return 0;
+}
+
+// Record pid and ppid in pgdir's struct vproc.  Once threads
+// share pgdir (pid -1), only clearing it with a new exec()
+// makes the page describe a process again.
+void
+setvproc(pde_t *pgdir, int pid, int ppid)
+{
+  struct vproc *vp;
+  pte_t *pte;
+
+  if((pte = walkpgdir(pgdir, (char*)UPROC, 0)) == 0 || (*pte & PTE_P) == 0)
+    return;
+  vp = (struct vproc*)tmpmap(PTE_ADDR(*pte));
+  if(vp->pid != -1){
+    vp->pid = pid;
+    vp->ppid = ppid;
+  }
+  tmpunmap((char*)vp);
+}
+
 // Load a program segment into pgdir.  addr must be page-aligned
 // and the pages from addr to addr+sz must already be mapped.
 int
@@ -199,9 +383,15 @@ loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
 {
   uint i, pa, n;
   pte_t *pte;
+  char *buf, *mem;
+  int r;
 
   if((uint) addr % PGSIZE != 0)
     panic("loaduvm: addr must be page aligned");
+  // readi() may sleep, which a tmpmap() of a high page does
+  // not allow, so high pages are read through buf.
+  buf = 0;
+  r = 0;
   for(i = 0; i < sz; i += PGSIZE){
     if((pte = walkpgdir(pgdir, addr+i, 0)) == 0)
       panic("loaduvm: address should exist");
@@ -210,10 +400,25 @@ loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
       n = sz - i;
     else
       n = PGSIZE;
-    if(readi(ip, P2V(pa), offset+i, n) != n)
-      return -1;
+    if(pa < phystop){
+      if(readi(ip, P2V(pa), offset+i, n) != n){
+        r = -1;
+        break;
+      }
+      continue;
+    }
+    if((buf == 0 && (buf = kalloc()) == 0) ||
+       readi(ip, buf, offset+i, n) != n){
+      r = -1;
+      break;
+    }
+    mem = tmpmap(pa);
+    memmove(mem, buf, n);
+    tmpunmap(mem);
   }
-  return 0;
+  if(buf)
+    kfree(buf);
+  return r;
 }
 
 // Allocate page tables and physical memory to grow process from oldsz to
@@ -221,27 +426,25 @@ loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
 int
 allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 {
-  char *mem;
-  uint a;
+  uint a, pa;
 
-  if(newsz >= KERNBASE)
+  if(newsz > UPROC)
     return 0;
   if(newsz < oldsz)
     return oldsz;
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
-    if(mem == 0){
+    pa = ualloc();
+    if(pa == 0){
       cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
-    if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
+    if(mappages(pgdir, (char*)a, PGSIZE, pa, PTE_W|PTE_U) < 0){
       cprintf("allocuvm out of memory (2)\n");
       deallocuvm(pgdir, newsz, oldsz);
-      kfree(mem);
+      ufree(pa);
       return 0;
     }
   }
@@ -251,11 +454,12 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 // Deallocate user pages to bring the process size from oldsz to
 // newsz.  oldsz and newsz need not be page-aligned, nor does newsz
 // need to be less than oldsz.  oldsz can be larger than the actual
-// process size.  Returns the new process size.
+// process size.  Swapped-out pages give up their swap slots.
+// Returns the new process size.
 int
 deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 {
-  pte_t *pte;
+  pte_t *pte, old;
   uint a, pa;
 
   if(newsz >= oldsz)
@@ -266,20 +470,58 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
     pte = walkpgdir(pgdir, (char*)a, 0);
     if(!pte)
       a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
-    else if((*pte & PTE_P) != 0){
-      pa = PTE_ADDR(*pte);
+    else if((*pte & (PTE_P|PTE_SWAP)) != 0){
+      // Another thread's swapfault() may be bringing the
+      // page in; whichever of us changes the PTE first wins.
+      old = xchg(pte, 0);
+      if(old & PTE_SWAP){
+        swapfree(PTE_SLOT(old));
+        continue;
+      }
+      pa = PTE_ADDR(old);
       if(pa == 0)
         panic("kfree");
-      char *v = P2V(pa);
-      kfree(v);
-      *pte = 0;
+      ufree(pa);
     }
   }
   return newsz;
 }
 
+// Like deallocuvm(), but working down from oldsz, unmap at
+// most max pages and store their old PTEs in ptes[] instead
+// of freeing the pages or swap slots; *n is set to how many.
+// Returns the size the process has left, which is newsz once
+// the whole range is unmapped.
+uint
+unmapuvm(pde_t *pgdir, uint oldsz, uint newsz, pte_t *ptes, int max, int *n)
+{
+  pte_t *pte, old;
+  uint a;
+
+  *n = 0;
+  if(newsz >= oldsz)
+    return oldsz;
+  a = PGROUNDUP(oldsz);
+  while(a > PGROUNDUP(newsz) && *n < max){
+    a -= PGSIZE;
+    pte = walkpgdir(pgdir, (char*)a, 0);
+    if(!pte)
+      a = PGADDR(PDX(a), 0, 0);
+    else if((*pte & (PTE_P|PTE_SWAP)) != 0){
+      old = xchg(pte, 0);
+      if((old & PTE_SWAP) == 0 && PTE_ADDR(old) == 0)
+        panic("unmapuvm");
+      ptes[(*n)++] = old;
+    }
+  }
+  return a <= PGROUNDUP(newsz) ? newsz : a;
+}
+
 // Free a page table and all the physical memory pages
-// in the user part.
+// in the user part.  The kernel part's page tables are
+// shared with kpgdir and stay.  Threads made by clone()
+// and CPUs that have the page table loaded hold a kalloc()
+// reference each; only the last one to let go frees it.
 void
 freevm(pde_t *pgdir)
 {
@@ -287,8 +529,10 @@ freevm(pde_t *pgdir)
 
   if(pgdir == 0)
     panic("freevm: no pgdir");
+  if(kunshare((char*)pgdir))
+    return;
   deallocuvm(pgdir, KERNBASE, 0);
-  for(i = 0; i < NPDENTRIES; i++){
+  for(i = 0; i < PDX(KERNBASE); i++){
     if(pgdir[i] & PTE_P){
       char * v = P2V(PTE_ADDR(pgdir[i]));
       kfree(v);
@@ -311,29 +555,42 @@ clearpteu(pde_t *pgdir, char *uva)
 }
 
 // Given a parent process's page table, create a copy
-// of it for a child.
+// of it for a child.  Pages the parent has in swap are
+// read into the child's copy.
 pde_t*
 copyuvm(pde_t *pgdir, uint sz)
 {
   pde_t *d;
-  pte_t *pte;
-  uint pa, i, flags;
-  char *mem;
+  pte_t *pte, e;
+  uint pa, npa, i, flags;
+  char *mem, *src;
 
   if((d = setupkvm()) == 0)
     return 0;
   for(i = 0; i < sz; i += PGSIZE){
     if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
       panic("copyuvm: pte should exist");
-    if(!(*pte & PTE_P))
+    e = *pte;
+    if(!(e & (PTE_P|PTE_SWAP)))
       panic("copyuvm: page not present");
-    pa = PTE_ADDR(*pte);
-    flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto bad;
-    memmove(mem, (char*)P2V(pa), PGSIZE);
-    if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0) {
-      kfree(mem);
+    pa = PTE_ADDR(e);
+    flags = PTE_FLAGS(e) & ~PTE_SWAP;
+    if((npa = highalloc()) == 0){
+      if((mem = kalloc()) == 0)
+        goto bad;
+      npa = V2P(mem);
+    }
+    if(e & PTE_SWAP){
+      swapread(PTE_SLOT(e), npa);
+    } else {
+      src = tmpmap(pa);
+      mem = tmpmap(npa);
+      memmove(mem, src, PGSIZE);
+      tmpunmap(mem);
+      tmpunmap(src);
+    }
+    if(mappages(d, (void*)i, PGSIZE, npa, flags) < 0) {
+      ufree(npa);
       goto bad;
     }
   }
@@ -345,39 +602,41 @@ bad:
 }
 
 //PAGEBREAK!
-// Map user virtual address to kernel address.
-char*
-uva2ka(pde_t *pgdir, char *uva)
+// Map user virtual address to physical address, or 0.
+uint
+uva2pa(pde_t *pgdir, char *uva)
 {
   pte_t *pte;
 
   pte = walkpgdir(pgdir, uva, 0);
-  if((*pte & PTE_P) == 0)
+  if(pte == 0 || (*pte & PTE_P) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
-  return (char*)P2V(PTE_ADDR(*pte));
+  return PTE_ADDR(*pte);
 }
 
 // Copy len bytes from p to user address va in page table pgdir.
 // Most useful when pgdir is not the current page table.
-// uva2ka ensures this only works for PTE_U pages.
+// uva2pa ensures this only works for PTE_U pages.
 int
 copyout(pde_t *pgdir, uint va, void *p, uint len)
 {
-  char *buf, *pa0;
-  uint n, va0;
+  char *buf, *ka0;
+  uint n, va0, pa0;
 
   buf = (char*)p;
   while(len > 0){
     va0 = (uint)PGROUNDDOWN(va);
-    pa0 = uva2ka(pgdir, (char*)va0);
+    pa0 = uva2pa(pgdir, (char*)va0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (va - va0);
     if(n > len)
       n = len;
-    memmove(pa0 + (va - va0), buf, n);
+    ka0 = tmpmap(pa0);
+    memmove(ka0 + (va - va0), buf, n);
+    tmpunmap(ka0);
     len -= n;
     buf += n;
     va = va0 + PGSIZE;